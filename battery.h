@@ -0,0 +1,178 @@
+#ifndef BATTERY_H
+#define BATTERY_H
+
+#include "tools.h"
+#include "cron.h"
+#include "wifi.h"
+#include "sensors.h"
+#include "services.h"
+
+/*
+   Режим питания от батареи (солнечной панели) с глубоким сном.
+   Включается определением batteryMode в v2.ino, требует перемычки GPIO16 (D0) - RST для пробуждения.
+   Цикл работы:
+    - пробуждение, проверка шины и сбор данных с датчиков
+    - добавление замера в буфер в RTC памяти (переживает глубокий сон)
+    - каждые batteryBatch пробуждений (или при заполнении буфера) подключение к WiFi и отправка накопленного
+      пакета MQTT брокеру (топик batch) и последнего замера через обычные сервисы. Подключение ждет не дольше
+      batteryConnect, без перехода в режим точки доступа, канал и BSSID прошлого подключения хранятся в RTC
+      памяти. После n неудач подряд следующие 2^n - 1 пробуждений (не больше batteryBackoff) WiFi не поднимают,
+      в буфере остаются последние замеры
+    - глубокий сон до следующего замера, так чтобы период между замерами оставался равным batteryInterval
+   Для оценки энергобюджета ведется учет времени бодрствования за цикл, статистика публикуется в топик battery.
+   Основной цикл loop() и web интерфейс в этом режиме не работают.
+*/
+#ifndef batteryInterval
+  #define batteryInterval cron::time_5m // Период между замерами
+#endif
+#ifndef batteryBatch
+  #define batteryBatch 4                // Количество замеров в пакете (каждое N-ое пробуждение поднимает WiFi)
+#endif
+#ifndef batterySensors
+  #define batterySensors 6              // Количество сенсоров (в порядке списка) сохраняемых в замере
+#endif
+#ifndef batteryConnect
+  #define batteryConnect 5000           // Ожидание подключения к WiFi в ms
+#endif
+#ifndef batteryBackoff
+  #define batteryBackoff 16             // Наибольшее количество пробуждений без попытки отправки после неудач
+#endif
+
+class battery {
+  public:
+    battery() { this->rtc = rtcMemory.reserve(sizeof(this->state)); }
+    /*
+       Полный цикл работы в режиме питания от батареи.
+       Вызывается в setup() после восстановления состояния сенсоров, управление не возвращает.
+       restored - фильтры сенсоров восстановлены из RTC памяти и достаточно одного замера.
+    */
+    void cycle(bool restored);
+
+  private:
+    /* Отправка накопленного пакета, true в случае успеха */
+    bool flush();
+    /* Уход в глубокий сон с сохранением состояния */
+    void sleep();
+
+    struct sample_t {
+      uint32_t age;                  // Время замера относительно начала пакета в ms
+      float value[batterySensors];
+    };
+    struct state_t {
+      uint32_t wakes;                // Количество пробуждений с момента холодного старта
+      uint32_t time;                 // Расчетное время от холодного старта в ms (сумма периодов)
+      uint32_t batchTime;            // Время начала пакета
+      uint32_t awakeLast;            // Время бодрствования в предыдущем цикле в ms
+      uint32_t awakeMax;             // Максимальное время бодрствования
+      uint32_t awakeTotal;           // Суммарное время бодрствования с холодного старта
+      uint16_t count;                // Количество замеров в буфере
+      uint16_t failed;               // Количество неудачных попыток отправки подряд
+      uint16_t skip;                 // Пробуждений до следующей попытки отправки (отсрочка после неудач)
+      uint8_t channel;               // Канал прошлого подключения (0 - неизвестен, подключение со сканированием)
+      uint8_t bssid[6];              // BSSID прошлого подключения
+      sample_t sample[batteryBatch];
+    } state;
+    int rtc = -1;
+} battery;
+
+/*  */
+void battery::cycle(bool restored = false) {
+  if (!rtcMemory.read(this->rtc, &this->state, sizeof(this->state))) memset(&this->state, 0, sizeof(this->state));
+  this->state.wakes++;
+
+  /* Замер (если фильтр сенсоров не восстановлен, замеры повторяются до формирования медианы) */
+  sensors.checkLine();
+  for (byte i = 0; i < (restored ? 1 : 3); i++) sensors.dataUpdate();
+
+  /* Добавление замера в буфер, при переполнении вытесняется самый старый */
+  if (!this->state.count) this->state.batchTime = this->state.time;
+  if (this->state.count >= batteryBatch) {
+    memmove(this->state.sample, this->state.sample + 1, sizeof(sample_t) * (batteryBatch - 1));
+    this->state.count = batteryBatch - 1;
+  }
+  sample_t &sample = this->state.sample[this->state.count++];
+  sample.age = this->state.time - this->state.batchTime;
+  byte i = 0;
+  sensors.each([&](device *sensor) {
+    if (i < batterySensors) sample.value[i++] = sensor->lastDimension;
+  });
+  while (i < batterySensors) sample.value[i++] = 0;
+
+  /* Каждое N-ое пробуждение - отправка пакета */
+  if (this->state.count >= batteryBatch) {
+    if (this->state.skip) this->state.skip--;
+    else if (this->flush()) {
+      this->state.count = 0;
+      this->state.failed = 0;
+    } else {
+      this->state.failed++;
+      this->state.skip = min((1UL << min(this->state.failed, (uint16_t)15)) - 1, (unsigned long)batteryBackoff);
+    }
+  }
+  this->sleep();
+}
+
+/*  */
+bool battery::flush() {
+  #ifdef console
+    console.printf("battery: flush %d samples\n", this->state.count);
+  #endif
+  if (!wifi.connect(batteryConnect, this->state.channel, this->state.channel ? this->state.bssid : 0)) {
+    this->state.channel = 0;  // Точка доступа могла сменить канал - следующая попытка со сканированием
+    return false;
+  }
+  this->state.channel = WiFi.channel();
+  memcpy(this->state.bssid, WiFi.BSSID(), sizeof(this->state.bssid));
+
+  bool status = true;
+  if (conf.param("mqtt_server").length()) {
+    if ((status = mqttConnect())) {
+      /* Пакет: имена сенсоров и массив замеров [смещение в секундах, значения...] */
+      String names, batch;
+      byte i = 0;
+      sensors.each([&](device *sensor) {
+        if (i++ < batterySensors) names += String(names.length() ? "," : "") + "\"" + sensor->name + "\"";
+      });
+      for (uint16_t n = 0; n < this->state.count; n++) {
+        String values = String(this->state.sample[n].age / 1000);
+        for (byte v = 0; v < batterySensors; v++) values += "," + String(this->state.sample[n].value[v]);
+        batch += String(batch.length() ? "," : "") + "[" + values + "]";
+      }
+      status = mqttPublish("batch", "{\"sensors\":[" + names + "],\"interval\":" + String(batteryInterval / 1000) + ",\"data\":[" + batch + "]}");
+
+      /* Энергобюджет: время бодрствования за цикл */
+      String stats;
+      stats += "\"wakes\":"      + String(this->state.wakes) + ",";
+      stats += "\"awakeLast\":"  + String(this->state.awakeLast) + ",";
+      stats += "\"awakeMax\":"   + String(this->state.awakeMax) + ",";
+      stats += "\"awakeAvg\":"   + String(this->state.wakes > 1 ? this->state.awakeTotal / (this->state.wakes - 1) : 0) + ",";
+      stats += "\"dutyCycle\":"  + String(this->state.time ? this->state.awakeTotal * 100.0 / this->state.time : 0, 3) + ",";
+      stats += "\"failed\":"     + String(this->state.failed);
+      mqttPublish("battery", "{" + stats + "}");
+      mqttAPI.disconnect();
+    }
+  }
+  /* Последний замер через обычные сервисы */
+  sendDataToThingSpeak();
+  sendDataToNarodmon();
+  return status;
+}
+
+/*  */
+void battery::sleep() {
+  uint32_t awake = millis();
+  this->state.awakeLast = awake;
+  this->state.awakeTotal += awake;
+  if (awake > this->state.awakeMax) this->state.awakeMax = awake;
+  uint32_t period = awake < batteryInterval ? batteryInterval - awake : cron::time_1s;
+  this->state.time += awake + period;
+  rtcMemory.write(this->rtc, &this->state, sizeof(this->state));
+  #ifdef console
+    console.printf("battery: awake %u ms, sleep %u ms\n", awake, period);
+    console.flush();
+  #endif
+  ESP.deepSleep((uint64_t)period * 1000, WAKE_RF_DEFAULT);
+  delay(100);
+}
+
+#endif
@@ -0,0 +1,129 @@
+#ifndef BUNDLE_H
+#define BUNDLE_H
+
+#include "storage.h"
+#include "tools.h"
+#include <WiFiClient.h>
+
+/*
+   Web интерфейс одним файлом (/bundle.bin), собирается tools/bundle.py из каталога data/.
+   Индекс (хэш пути, смещение, длина, ETag, тип содержимого) загружается в память при первом обращении,
+   поиск - двоичный по хэшу, файлы отдаются срезами из одного открытого файла без обращения к
+   метаданным SPIFFS. При отсутствии или повреждении пакета web сервер отдает отдельные файлы SPIFFS.
+*/
+class bundle {
+  public:
+    struct entry_t {
+      uint32_t hash;
+      uint32_t offset;
+      uint32_t length;
+      uint32_t etag;
+      uint16_t type;      // Смещение типа содержимого в таблице строк
+      uint16_t flags;
+    };
+    enum { gzipped = 1 };
+    /*
+       Поиск файла по пути запроса, 0 если пакета нет или файл в нем отсутствует
+    */
+    const entry_t *find(const String &path);
+    /*
+       Тип содержимого файла
+    */
+    const char *type(const entry_t *entry) { return this->strings + entry->type; }
+    /*
+       Передача файла клиенту, возвращает количество переданных байт
+    */
+    size_t send(WiFiClient &client, const entry_t *entry);
+    /*
+       Закрытие пакета (перед загрузкой или удалением файлов), при следующем обращении он будет открыт заново
+    */
+    void reset();
+    /* FNV-1a */
+    static uint32_t hash(const char *text) { return fnv1a(text); }
+
+  private:
+    bool open();
+
+    const char *fileName = "/bundle.bin";
+    File file;
+    entry_t *index = 0;
+    char *strings = 0;
+    uint16_t count = 0;
+    bool opened = false;
+} bundle;
+
+/*  */
+bool bundle::open() {
+  this->opened = true;
+  if (!storage.fs().exists(this->fileName)) return false;
+  this->file = storage.fs().open(this->fileName, "r");
+  struct {
+    char magic[4];
+    uint16_t count;
+    uint16_t strings;
+  } header;
+  if (!this->file or this->file.read((uint8_t *)&header, sizeof(header)) != sizeof(header) or memcmp(header.magic, "WSB1", 4)) {
+    this->reset();
+    this->opened = true;
+    return false;
+  }
+  this->index = new entry_t[header.count];
+  this->strings = new char[header.strings + 1];
+  this->strings[header.strings] = 0;
+  size_t size = header.count * sizeof(entry_t);
+  bool status = this->file.read((uint8_t *)this->index, size) == size and this->file.read((uint8_t *)this->strings, header.strings) == header.strings;
+  /* Прерванная загрузка: данные последнего файла должны поместиться в пакет */
+  for (uint16_t i = 0; status and i < header.count; i++) {
+    status = this->index[i].offset + this->index[i].length <= this->file.size() and this->index[i].type < header.strings;
+  }
+  if (!status) {
+    this->reset();
+    this->opened = true;
+    return false;
+  }
+  this->count = header.count;
+  #ifdef console
+    console.printf("bundle: %d files\n", this->count);
+  #endif
+  return true;
+}
+
+/*  */
+const bundle::entry_t *bundle::find(const String &path) {
+  if (!this->opened) this->open();
+  if (!this->count) return 0;
+  uint32_t hash = bundle::hash(path.c_str());
+  int16_t low = 0, high = this->count - 1;
+  while (low <= high) {
+    int16_t middle = (low + high) / 2;
+    if (this->index[middle].hash == hash) return &this->index[middle];
+    if (this->index[middle].hash < hash) low = middle + 1;
+    else high = middle - 1;
+  } return 0;
+}
+
+/*  */
+size_t bundle::send(WiFiClient &client, const entry_t *entry) {
+  uint8_t buffer[512];
+  size_t sent = 0;
+  if (!this->file.seek(entry->offset, SeekSet)) return 0;
+  while (sent < entry->length and client.connected()) {
+    size_t part = entry->length - sent < sizeof(buffer) ? entry->length - sent : sizeof(buffer);
+    part = this->file.read(buffer, part);
+    if (!part or client.write(buffer, part) != part) break;
+    sent += part;
+  } return sent;
+}
+
+/*  */
+void bundle::reset() {
+  if (this->file) this->file.close();
+  delete [] this->index;
+  delete [] this->strings;
+  this->index = 0;
+  this->strings = 0;
+  this->count = 0;
+  this->opened = false;
+}
+
+#endif
@@ -0,0 +1,249 @@
+#ifndef COLLECTOR_H
+#define COLLECTOR_H
+
+#include <WiFiUdp.h>
+#include "config.h"
+#include "cron.h"
+#include "wifi.h"
+#include "sensors.h"
+#include "webserver.h"
+
+/*
+   Сбор показаний нескольких станций площадки на одной (режим коллектора) по UDP.
+   Параметры конфигурации:
+    - collector_mode   - пусто: выключено, member: станция отправляет показания, collector: станция принимает показания
+    - collector_server - IP адрес коллектора (для member)
+   Станция в режиме member после каждого цикла сбора данных отправляет коллектору одну датаграмму:
+     'WSC1', uint32 chipId, uint16 номер пакета, uint8 количество, затем по каждому сенсору
+     uint8 длина имени, имя, float значение (little-endian)
+   Коллектор добавляет сенсоры станций в свой список под префиксом <chipId в hex>_, параметры индикатора
+   берутся у своего сенсора с тем же именем. Далее они доступны в /api/sensors, журналах и сервисах
+   как обычные сенсоры. Если от станции нет данных дольше timeout, ее сенсоры помечаются отсутствующими
+   (как не найденный датчик). Количество станций и сенсоров ограничено, статистика - /api/system/collector.
+   Для проверки пропускной способности: tools/fake_nodes.py.
+*/
+class collector {
+  public:
+    enum {
+      port = 4210,
+      nodes = 16,          // Максимум станций
+      remoteSensors = 64,  // Максимум сенсоров станций
+      packetSize = 512,
+      timeout = cron::time_1m  // Нет данных от станции - ее сенсоры отсутствуют
+    };
+    /*
+       Запуск в соответствии с конфигурацией, вызывается в setup() после регистрации сенсоров
+    */
+    void begin();
+    /*
+       Статистика коллектора
+    */
+    json stats();
+
+  private:
+    struct node_t {
+      uint32_t chip;
+      uint16_t sequence;
+      uint32_t packets = 0;
+      uint32_t lost = 0;
+      uint32_t seen = 0;
+      node_t *next;
+    };
+    struct remote_t {
+      device *sensor;
+      node_t *node;
+      float value;
+      remote_t *next;
+    };
+    /* Отправка показаний коллектору */
+    void send();
+    /* Прием и разбор датаграмм */
+    void receive();
+    void parse(const uint8_t *data, size_t size);
+    void expire();
+    node_t *node(uint32_t chip);
+    remote_t *remote(const char *name);
+
+    WiFiUDP udp;
+    IPAddress server;
+    node_t *nodeList = 0;
+    remote_t *remoteList = 0;
+    uint8_t nodeCount = 0;
+    uint8_t sensorCount = 0;
+    uint16_t sequence = 0;
+    uint32_t received = 0, rejected = 0, dropped = 0;
+    bool member = false, active = false;
+} collector;
+
+/*  */
+void collector::begin() {
+  String mode = conf.param("collector_mode");
+  if (mode == F("member")) {
+    if (!this->server.fromString(conf.param("collector_server"))) return;
+    this->member = true;
+    sensors.onUpdate([this](){ this->send(); });
+  } else if (mode == F("collector")) {
+    this->active = this->udp.begin(collector::port);
+    cron.add(50, [this](){ this->receive(); }, "collectorReceive");
+    cron.add(cron::time_5s, [this](){ this->expire(); }, "collectorExpire", cron::low);
+    http.on("/api/system/collector", HTTP_GET, [this](){
+      http.sendServerHeaders();
+      if (http.authorized()) http.send(200, headerJson, this->stats());
+      else http.send(401);
+    });
+  } else return;
+  #ifdef console
+    console.printf("collector: %s mode\n", mode.c_str());
+  #endif
+}
+
+/*  */
+void collector::send() {
+  if (!wifi.transferDataPossible()) return;
+  uint8_t packet[collector::packetSize];
+  uint32_t chip = ESP.getChipId();
+  size_t size = 0;
+  memcpy(packet, "WSC1", 4);
+  memcpy(packet + 4, &chip, 4);
+  this->sequence++;
+  memcpy(packet + 8, &this->sequence, 2);
+  uint8_t count = 0;
+  size = 11;
+  sensors.each([&](device *sensor) {
+    size_t length = strlen(sensor->name);
+    if (sensor->remote or length > 255 or size + 1 + length + 4 > sizeof(packet)) return;
+    float value = sensor->lastDimension;
+    packet[size++] = length;
+    memcpy(packet + size, sensor->name, length);
+    memcpy(packet + size + length, &value, 4);
+    size += length + 4;
+    count++;
+  });
+  packet[10] = count;
+  this->udp.beginPacket(this->server, collector::port);
+  this->udp.write(packet, size);
+  this->udp.endPacket();
+}
+
+/*  */
+void collector::receive() {
+  /* Не больше нескольких датаграмм за вызов, чтобы не задерживать основной цикл */
+  for (uint8_t i = 0; i < 8; i++) {
+    int size = this->udp.parsePacket();
+    if (size <= 0) return;
+    uint8_t packet[collector::packetSize];
+    size = this->udp.read(packet, sizeof(packet));
+    if (size > 0) this->parse(packet, size);
+  }
+}
+
+/*  */
+void collector::parse(const uint8_t *data, size_t size) {
+  uint32_t chip;
+  uint16_t sequence;
+  if (size < 11 or memcmp(data, "WSC1", 4)) {
+    this->rejected++;
+    return;
+  }
+  memcpy(&chip, data + 4, 4);
+  memcpy(&sequence, data + 8, 2);
+  node_t *node = this->node(chip);
+  if (!node) {
+    this->rejected++;
+    return;
+  }
+  this->received++;
+  if (node->packets and (uint16_t)(sequence - node->sequence) > 1) node->lost += (uint16_t)(sequence - node->sequence) - 1;
+  node->sequence = sequence;
+  node->packets++;
+  node->seen = millis();
+
+  char prefix[10];
+  snprintf(prefix, sizeof(prefix), "%06x_", chip & 0xFFFFFF);
+  size_t position = 11;
+  for (uint8_t n = 0; n < data[10]; n++) {
+    if (position >= size) break;
+    uint8_t length = data[position++];
+    if (position + length + 4 > size) break;
+    String local;
+    local.reserve(length);
+    for (uint8_t i = 0; i < length; i++) local += (char)data[position + i];
+    String name = prefix + local;
+    float value;
+    memcpy(&value, data + position + length, 4);
+    position += length + 4;
+
+    remote_t *remote = this->remote(name.c_str());
+    if (!remote) {
+      if (this->sensorCount >= collector::remoteSensors or sensors.find(name.c_str())) {
+        this->dropped++;
+        continue;
+      }
+      /* Параметры индикатора и журнал - как у своего сенсора с тем же именем */
+      device *twin = sensors.find(local.c_str());
+      static knob_t *generic = new knob_t(-1000, 1000, ".01", "", "");
+      remote = new remote_t{0, node, value, this->remoteList};
+      sensors.add(twin ? twin->knob : generic, twin ? twin->list : device::out, strdup(name.c_str()), [remote](){ return remote->value; }, twin and twin->logDepth);
+      remote->sensor = sensors.find(name.c_str());
+      remote->sensor->remote = true;
+      remote->sensor->status = true;
+      remote->sensor->lastDimension.fill(value);
+      this->remoteList = remote;
+      this->sensorCount++;
+    }
+    remote->value = value;
+    remote->sensor->status = true;
+  }
+}
+
+/*  */
+void collector::expire() {
+  for (remote_t *remote = this->remoteList; remote; remote = remote->next) {
+    if (remote->sensor->status and millis() - remote->node->seen > collector::timeout) remote->sensor->status = false;
+  }
+}
+
+/*  */
+collector::remote_t *collector::remote(const char *name) {
+  for (remote_t *remote = this->remoteList; remote; remote = remote->next) {
+    if (!strcmp(remote->sensor->name, name)) return remote;
+  } return 0;
+}
+
+/*  */
+collector::node_t *collector::node(uint32_t chip) {
+  for (node_t *node = this->nodeList; node; node = node->next) {
+    if (node->chip == chip) return node;
+  }
+  if (this->nodeCount >= collector::nodes) return 0;
+  node_t *node = new node_t;
+  node->chip = chip;
+  node->next = this->nodeList;
+  this->nodeList = node;
+  this->nodeCount++;
+  return node;
+}
+
+/*  */
+json collector::stats() {
+  String list;
+  for (node_t *node = this->nodeList; node; node = node->next) {
+    char chip[8];
+    snprintf(chip, sizeof(chip), "%06x", node->chip & 0xFFFFFF);
+    String item;
+    item += "\"packets\":" + String(node->packets) + ",";
+    item += "\"lost\":"    + String(node->lost) + ",";
+    item += "\"age\":"     + String(millis() - node->seen);
+    list += String(list.length() ? "," : "") + "\"" + chip + "\":{" + item + "}";
+  }
+  String answer;
+  answer += "\"received\":" + String(this->received) + ",";
+  answer += "\"rejected\":" + String(this->rejected) + ",";
+  answer += "\"dropped\":"  + String(this->dropped) + ",";
+  answer += "\"sensors\":"  + String(this->sensorCount) + ",";
+  answer += "\"freeHeap\":" + String(ESP.getFreeHeap()) + ",";
+  answer += "\"nodes\":{"   + list + "}";
+  return "{" + answer + "}";
+}
+
+#endif
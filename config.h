@@ -9,7 +9,7 @@
 #ifndef CONFIG_H
 #define CONFIG_H
 
-#include <FS.h>
+#include "storage.h"
 
 class configParameter {
   public:
@@ -93,7 +93,7 @@ class config {
 
 /*  */
 config::config(const char *file) {
-  SPIFFS.begin();
+  storage.begin();
   this->spiffsFile = file;
 }
 
@@ -146,7 +146,7 @@ void config::print(/*HardwareSerial &console*/) {
 /*  */
 bool config::read() {
   if (this->parameterList) {
-    File configFile = SPIFFS.open(this->spiffsFile, "r");
+    File configFile = storage.fs().open(this->spiffsFile, "r");
     if (configFile) {
       DynamicJsonBuffer jsonBuffer;
       JsonObject &json = jsonBuffer.parseObject(configFile);
@@ -158,7 +158,7 @@ bool config::read() {
           parameter = parameter->next;
           yield();
         } return true;
-      } SPIFFS.remove(spiffsFile);
+      } storage.fs().remove(spiffsFile);
     }
   } return false;
 }
@@ -166,7 +166,7 @@ bool config::read() {
 /*  */
 bool config::write() {
   if (this->parameterList) {
-    File configFile = SPIFFS.open(this->spiffsFile, "w");
+    File configFile = storage.fs().open(this->spiffsFile, "w");
     if (configFile) {
       DynamicJsonBuffer jsonBuffer;
       JsonObject& json = jsonBuffer.createObject();
@@ -200,8 +200,8 @@ bool config::write(String apiSave) {
 
 /*  */
 bool config::remove() {
-  if (!SPIFFS.exists(this->spiffsFile)) return false;
-  return SPIFFS.remove(this->spiffsFile);
+  if (!storage.fs().exists(this->spiffsFile)) return false;
+  return storage.fs().remove(this->spiffsFile);
 }
 
 /*  */
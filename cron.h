@@ -1,6 +1,8 @@
 #ifndef CRON_H
 #define CRON_H
 
+#include "supervisor.h"
+
 class cronEvent {
   public:
     typedef std::function<void(void)> cronUserFunction_t;
@@ -16,6 +18,11 @@ class cronEvent {
     cronUserFunction_t function;
     cronEvent *next = 0;
     const char *id;
+    uint8_t priority = 1;
+    uint8_t mode = 0;        // Режим расписания (cron::fixedDelay, cron::fixedRate, cron::aligned)
+    uint8_t catchup = 0;     // Пропущенные запуски в режиме fixedRate (cron::skip, cron::burst)
+    bool synced = false;     // Режим aligned: фаза выставлена по часам
+    uint32_t boundary = 0;   // Режим aligned: номер границы интервала, на которую назначен запуск
 };
 
 class cron {  
@@ -45,14 +52,51 @@ class cron {
       hour   = cron::time_1h,
       day    = cron::time_1d
     };
+    /*
+       Приоритеты заданий. Задания высокого приоритета выполняются всегда, остальные - пока не исчерпан
+       бюджет времени итерации handleEvents (budget ms), иначе откладываются до следующей итерации.
+       Задание, просроченное больше чем на свой интервал, выполняется вне бюджета.
+    */
+    enum {
+      high   = 0,
+      normal = 1,
+      low    = 2
+    };
+    enum { budget = 50 };
+    /*
+       Задания с одинаковым интервалом разносятся по фазе на долю интервала (не больше phases фаз).
+       Фаза только откладывает первый запуск, поэтому задание, добавленное во время работы, не срабатывает раньше интервала.
+    */
+    enum { phases = 8 };
+    /*
+       Режимы расписания задания:
+        - fixedDelay - следующий запуск через интервал после окончания предыдущего (по умолчанию), период
+                       удлиняется на время выполнения задания и задержки основного цикла
+        - fixedRate  - запуски через равные интервалы от первого (time += interval) без накопления ухода;
+                       запуски, пропущенные из-за долгих заданий, отбрасываются с сохранением фазы (skip)
+                       или выполняются подряд (burst, не больше burstMax)
+        - aligned    - запуски на границах интервала по часам (10 минут: :00, :10, :20...) с точностью до
+                       секунды; пока время неизвестно - как fixedRate. Интервал должен делить сутки,
+                       пропущенные границы отбрасываются.
+    */
+    enum {
+      fixedDelay = 0,
+      fixedRate  = 1,
+      aligned    = 2
+    };
+    enum {
+      skip  = 0,
+      burst = 1
+    };
+    enum { burstMax = 4 };
     /*
        Добавление нового задания в планировщик.
        В качестве аргумента принимает интервал вызова в ms и имя вызываемой функции.
-       Последний, не обязательный, параметр устанавливает идентификатор для поиска задачи.
+       Не обязательные параметры устанавливают идентификатор для поиска задачи и приоритет.
        Параметр coldStart при значении true заставит произвести первый запуск при добавлении задачи в очередь, а не по таймеру.
     */
-    void add(unsigned long interval, cronEvent::cronUserFunction_t fn, const char *id);
-    void add(unsigned long interval, cronEvent::cronUserFunction_t fn, bool coldStart, const char *id);
+    void add(unsigned long interval, cronEvent::cronUserFunction_t fn, const char *id, uint8_t priority);
+    void add(unsigned long interval, cronEvent::cronUserFunction_t fn, bool coldStart, const char *id, uint8_t priority);
     /*
        Обработчик очереди заданий.
        Прописывается в основном цикле программы как cron.handleEvents();
@@ -78,41 +122,103 @@ class cron {
        Остановка выполнения задания.
     */
     void stop(const char *id);
+    /*
+       Режим расписания задания и политика пропущенных запусков.
+    */
+    void schedule(const char *id, uint8_t mode, uint8_t catchup);
+    /*
+       Источник настенного времени для режима aligned: секунды с 01.01.1970 или 0 если время неизвестно.
+    */
+    void clock(std::function<uint32_t(void)> fn) { this->wallClock = fn; }
     /*
        Проверяет активна задача или нет.
     */
     bool isActive(const char *id);
+    /*
+       Количество отложенных по бюджету запусков с момента старта (/api/system/info, cronDeferred).
+    */
+    uint32_t deferred = 0;
 
   private:
+    void reschedule(cronEvent *event);
+
     cronEvent *eventList = 0;
+    std::function<uint32_t(void)> wallClock;
 } cron;
 
-/*  */
-void cron::add(unsigned long interval, cronEvent::cronUserFunction_t fn, const char *id = 0) {
-  cronEvent *newEvent = new cronEvent(interval, fn, this->eventList, id);
-  this->eventList = newEvent;
+/*
+   Очередь упорядочена по приоритету (внутри приоритета - новые задания первыми), поэтому обработчик
+   проходит ее один раз.
+*/
+void cron::add(unsigned long interval, cronEvent::cronUserFunction_t fn, const char *id = 0, uint8_t priority = cron::normal) {
+  cronEvent **position = &this->eventList;
+  while (*position and (*position)->priority < priority) position = &(*position)->next;
+  cronEvent *newEvent = new cronEvent(interval, fn, *position, id);
+  newEvent->priority = priority;
+  /* Разнесение по фазе: задания с одинаковым интервалом не срабатывают в одной итерации (lastRun() до первого запуска - 0) */
+  byte same = 0;
+  for (cronEvent *event = this->eventList; event; event = event->next) if (event->interval == interval) same++;
+  newEvent->time += (same % cron::phases) * (interval / cron::phases);
+  *position = newEvent;
 }
 
 /*  */
-void cron::add(unsigned long interval, cronEvent::cronUserFunction_t fn, bool coldStart, const char *id = 0) {
-  this->add(interval, fn, id);
+void cron::add(unsigned long interval, cronEvent::cronUserFunction_t fn, bool coldStart, const char *id = 0, uint8_t priority = cron::normal) {
+  this->add(interval, fn, id, priority);
   if (coldStart) fn();
 }
 
 /*  */
 void cron::handleEvents() {
   if (this->eventList) {
+    unsigned long start = millis();
     cronEvent *currentEvent = this->eventList;
     while (currentEvent) {
-      if (currentEvent->interval and this->lastRun(currentEvent) > currentEvent->interval) {
-        currentEvent->function();
-        currentEvent->time = millis();
-        yield();
+      /* Фаза выставляется по часам сразу, как только время стало известно */
+      if (currentEvent->mode == cron::aligned and !currentEvent->synced and this->wallClock and this->wallClock()) this->reschedule(currentEvent);
+      unsigned long late = currentEvent->interval ? this->lastRun(currentEvent) : 0;
+      if (late > currentEvent->interval) {
+        if (currentEvent->priority == cron::high or millis() - start < cron::budget or late > currentEvent->interval * 2) {
+          supervisor.enter(supervisor::cron, currentEvent->id, currentEvent->interval);
+          currentEvent->function();
+          supervisor.leave();
+          this->reschedule(currentEvent);
+          yield();
+        } else this->deferred++;
       } currentEvent = currentEvent->next;
     }
   }
 }
 
+/*  */
+void cron::reschedule(cronEvent *event) {
+  if (event->mode == cron::fixedDelay) {
+    event->time = millis();
+    return;
+  }
+  uint32_t wall = event->mode == cron::aligned and event->interval % cron::second == 0 and this->wallClock ? this->wallClock() : 0;
+  if (wall) {
+    /*
+       Номер следующей границы. После запуска отсчет идет от ближайшей границы: при подводе часов (NTP)
+       секундная фаза now() сдвигается, и запуск может прийти, когда часы еще показывают секунду до нее.
+       Одна и та же граница дважды не назначается.
+    */
+    uint32_t seconds = event->interval / cron::second;
+    uint32_t boundary = event->synced ? (wall + seconds / 2) / seconds + 1 : wall / seconds + 1;
+    if (boundary == event->boundary) boundary++;
+    event->boundary = boundary;
+    /* Время задания может оказаться в будущем (до границы больше интервала), lastRun() тогда возвращает 0 */
+    event->time = millis() + (boundary * seconds - wall) * cron::second - event->interval;
+    event->synced = true;
+    return;
+  }
+  event->time += event->interval;
+  unsigned long behind = this->lastRun(event);
+  if (behind > event->interval and (event->catchup == cron::skip or behind > event->interval * cron::burstMax)) {
+    event->time += (behind / event->interval) * event->interval;
+  }
+}
+
 /*  */
 cronEvent *cron::find(const char *id) {
   if (this->eventList) {
@@ -127,8 +233,9 @@ cronEvent *cron::find(const char *id) {
 /*  */
 unsigned long cron::lastRun(cronEvent *event) {
   if (event) {
-    unsigned long currentTime = millis();
-    return (currentTime > event->time) ? currentTime - event->time : currentTime + (0xffffffff - event->time) + 1;
+    /* Разность по модулю 2^32 переживает переполнение millis(), отрицательная - запуск назначен на будущее */
+    unsigned long elapsed = (uint32_t)(millis() - event->time);
+    return (int32_t)elapsed < 0 ? 0 : elapsed;
   } return 0;
 }
 
@@ -159,6 +266,16 @@ void cron::stop(const char *id) {
   if (event) event->interval = 0;
 }
 
+/*  */
+void cron::schedule(const char *id, uint8_t mode, uint8_t catchup = cron::skip) {
+  cronEvent *event = this->find(id);
+  if (event) {
+    event->mode = mode;
+    event->catchup = catchup;
+    event->synced = false;
+  }
+}
+
 /*  */
 bool cron::isActive(const char *id) {
   cronEvent *event = this->find(id);
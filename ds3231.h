@@ -1,14 +1,196 @@
+#ifndef DS3231_H
+#define DS3231_H
 
+#include <Wire.h>
+#include <NTPClient.h>
+#include <WiFiUdp.h>
+#include "cron.h"
+#include "wifi.h"
 
-
-
-  
-
-  
 // NTP
 WiFiUDP ntpUDP;
 NTPClient timeClient(ntpUDP, "pool.ntp.org", 28800,60000);
 
+/*
+   Часы реального времени DS3231 на общей шине i2c.
+   При старте время читается из микросхемы одним пакетом (7 регистров), поэтому настенное время известно сразу,
+   без ожидания WiFi и NTP. После успешной синхронизации с NTP часы подводятся, если расхождение больше секунды.
+   Без связи время берется из DS3231, между чтениями ведется по millis().
+   Хранится местное время (смещение часового пояса задано в NTP клиенте), 24-х часовой формат.
+   Если микросхема отсутствует, класс работает только от NTP.
+*/
+class ds3231 {
+  public:
+    enum { address = 0x68 };
+    /*
+       Чтение времени из микросхемы и постановка задачи синхронизации с NTP в планировщик.
+       Вызывается после инициализации шины i2c.
+    */
+    void begin();
+    /*
+       Местное время в секундах с 01.01.1970 или 0 если время неизвестно.
+    */
+    uint32_t now();
+    /*
+       Текущий час или -1 если время неизвестно.
+    */
+    int hours();
+    /*
+       Источник текущего времени: "ntp", "rtc" или "none".
+    */
+    const char *source();
+    /*
+       Пакетное чтение и запись времени в микросхему.
+       Чтение возвращает false если микросхема не отвечает или ее генератор останавливался (время недостоверно).
+    */
+    bool read(uint32_t &epoch);
+    bool write(uint32_t epoch);
+    /*
+       Синхронизация с NTP и подводка часов микросхемы.
+    */
+    void sync();
+
+  private:
+    static uint8_t bcd2dec(uint8_t value) { return (value >> 4) * 10 + (value & 0x0F); }
+    static uint8_t dec2bcd(uint8_t value) { return ((value / 10) << 4) | (value % 10); }
+    /* Преобразование даты в количество дней с 01.01.1970 и обратно (григорианский календарь) */
+    static int32_t daysFromCivil(int32_t y, uint8_t m, uint8_t d);
+    static void civilFromDays(int32_t days, int32_t &y, uint8_t &m, uint8_t &d);
+    void set(uint32_t epoch, bool ntp);
+
+    uint32_t epoch = 0;     // Время на момент последней установки
+    uint32_t base = 0;      // millis() на момент последней установки
+    bool present = false;   // Микросхема найдена на шине
+    bool ntp = false;       // Последняя установка выполнена по NTP
+} ds3231;
+
+/*  */
+void ds3231::begin() {
+  uint32_t epoch;
+  Wire.beginTransmission(ds3231::address);
+  this->present = (Wire.endTransmission() == 0);
+  if (this->read(epoch)) this->set(epoch, false);
+  #ifdef console
+    console.printf("ds3231: %s, time %u\n", this->present ? "found" : "not found", this->now());
+  #endif
+  /* Настенное время для заданий планировщика, выровненных по часам */
+  cron.clock([this](){ return this->now(); });
+  /* Пока нет синхронизации с NTP - попытка раз в минуту, после - раз в час */
+  cron.add(cron::time_1m, [this](){ this->sync(); }, "ntpSync", cron::low);
+}
+
+/*  */
+uint32_t ds3231::now() {
+  return this->epoch ? this->epoch + (millis() - this->base) / 1000 : 0;
+}
+
+/*  */
+int ds3231::hours() {
+  uint32_t now = this->now();
+  return now ? (now % 86400L) / 3600 : -1;
+}
+
+/*  */
+const char *ds3231::source() {
+  return !this->epoch ? "none" : (this->ntp ? "ntp" : "rtc");
+}
+
+/*  */
+void ds3231::set(uint32_t epoch, bool ntp) {
+  this->epoch = epoch;
+  this->base = millis();
+  this->ntp = ntp;
+}
+
+/*  */
+bool ds3231::read(uint32_t &epoch) {
+  if (!this->present) return false;
+  /* Флаг остановки генератора (OSF) в регистре статуса - время потеряно при отключении питания */
+  Wire.beginTransmission(ds3231::address);
+  Wire.write(0x0F);
+  if (Wire.endTransmission() != 0 or Wire.requestFrom(ds3231::address, 1) != 1) return false;
+  if (Wire.read() & 0x80) return false;
+  /* Пакетное чтение регистров 0x00..0x06 */
+  Wire.beginTransmission(ds3231::address);
+  Wire.write(0x00);
+  if (Wire.endTransmission() != 0 or Wire.requestFrom(ds3231::address, 7) != 7) return false;
+  uint8_t r[7];
+  for (byte i = 0; i < 7; i++) r[i] = Wire.read();
+  uint8_t second = bcd2dec(r[0] & 0x7F);
+  uint8_t minute = bcd2dec(r[1] & 0x7F);
+  uint8_t hour   = (r[2] & 0x40) ? bcd2dec(r[2] & 0x1F) % 12 + ((r[2] & 0x20) ? 12 : 0) : bcd2dec(r[2] & 0x3F);
+  uint8_t day    = bcd2dec(r[4] & 0x3F);
+  uint8_t month  = bcd2dec(r[5] & 0x1F);
+  int32_t year   = 2000 + bcd2dec(r[6]) + ((r[5] & 0x80) ? 100 : 0);
+  if (!day or day > 31 or !month or month > 12 or hour > 23 or minute > 59 or second > 59) return false;
+  epoch = daysFromCivil(year, month, day) * 86400L + hour * 3600L + minute * 60L + second;
+  return true;
+}
+
+/*  */
+bool ds3231::write(uint32_t epoch) {
+  if (!this->present) return false;
+  int32_t year;
+  uint8_t month, day;
+  int32_t days = epoch / 86400L;
+  uint32_t time = epoch % 86400L;
+  civilFromDays(days, year, month, day);
+  Wire.beginTransmission(ds3231::address);
+  Wire.write(0x00);
+  Wire.write(dec2bcd(time % 60));
+  Wire.write(dec2bcd(time / 60 % 60));
+  Wire.write(dec2bcd(time / 3600));             // 24-х часовой формат
+  Wire.write((days + 3) % 7 + 1);               // 01.01.1970 - четверг, 1 - понедельник
+  Wire.write(dec2bcd(day));
+  Wire.write(dec2bcd(month) | (year >= 2100 ? 0x80 : 0));
+  Wire.write(dec2bcd(year % 100));
+  if (Wire.endTransmission() != 0) return false;
+  /* Сброс флага остановки генератора */
+  Wire.beginTransmission(ds3231::address);
+  Wire.write(0x0F);
+  Wire.write(0x00);
+  return Wire.endTransmission() == 0;
+}
+
+/*  */
+void ds3231::sync() {
+  if (!wifi.transferDataPossible()) return;
+  static bool started = false;
+  if (!started) {
+    timeClient.begin();
+    started = true;
+  }
+  if (!timeClient.forceUpdate()) return;
+  uint32_t epoch = timeClient.getEpochTime();
+  uint32_t rtc;
+  if (this->present and (!this->read(rtc) or (rtc > epoch ? rtc - epoch : epoch - rtc) > 1)) this->write(epoch);
+  this->set(epoch, true);
+  cron.update("ntpSync", cron::time_1h);
+}
+
+/*  */
+int32_t ds3231::daysFromCivil(int32_t y, uint8_t m, uint8_t d) {
+  y -= m <= 2;
+  int32_t era = (y >= 0 ? y : y - 399) / 400;
+  uint32_t yoe = y - era * 400;
+  uint32_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+  uint32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + (int32_t)doe - 719468;
+}
+
+/*  */
+void ds3231::civilFromDays(int32_t days, int32_t &y, uint8_t &m, uint8_t &d) {
+  days += 719468;
+  int32_t era = (days >= 0 ? days : days - 146096) / 146097;
+  uint32_t doe = days - era * 146097;
+  uint32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  uint32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  uint32_t mp = (5 * doy + 2) / 153;
+  d = doy - (153 * mp + 2) / 5 + 1;
+  m = mp < 10 ? mp + 3 : mp - 9;
+  y = (int32_t)yoe + era * 400 + (m <= 2);
+}
+
 bool heating_season_Flag = 0;
 bool RTC_Valid_Flag = 0;
 byte tariff = 0;
@@ -18,10 +200,11 @@ void Pds(){
   // int a = BME.pres(BME280::PresUnit_torr);
  b = sensors.get("out_humidity");
   c = sensors.get("out_temperature");
-timeClient.begin();
-timeClient.update();
-console.println(timeClient.getFormattedTime());
-int hh = timeClient.getHours();
+/* Час берется из DS3231 или NTP, если время неизвестно - условия по часу не срабатывают */
+int hh = ds3231.hours();
+#ifdef console
+  console.println(ds3231.source());
+#endif
 if(((hh)==21)&&((c)<15) && ((b)<55)){
   z = 1;
 }
@@ -99,3 +282,5 @@ console.println(hh);
 
 
 }
+
+#endif
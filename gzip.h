@@ -0,0 +1,269 @@
+#ifndef GZIP_H
+#define GZIP_H
+
+/*
+   Потоковый gzip кодировщик для динамических ответов web сервера.
+   Deflate с фиксированными кодами Хаффмана и LZ77 с небольшим окном (1 КБ, одна позиция на хэш),
+   памяти около 3 КБ на время ответа. Данные подаются порциями через write(), сжатые данные
+   отдаются порциями в функцию out, finish() дописывает завершающий блок, CRC32 и длину.
+   Ограничение процессорного времени: после исчерпания бюджета остаток потока передается
+   несжатыми (stored) блоками, чтобы длинный ответ не задерживал основной цикл.
+
+    gzip stream([](const uint8_t *data, size_t size) { client.write(data, size); });
+    stream.write(answer);
+    stream.finish();
+*/
+class gzip {
+  public:
+    typedef std::function<void(const uint8_t *, size_t)> out_t;
+    enum {
+      window = 1024,      // Окно поиска совпадений
+      lookahead = 258,    // Максимальная длина совпадения
+      hashSize = 512,
+      bufferSize = 512    // Буфер выходных данных
+    };
+
+    gzip(out_t out, uint32_t budget = 40000): out(out), budget(budget) {
+      this->data = new uint8_t[gzip::window * 2];
+      this->head = new int16_t[gzip::hashSize];
+      for (uint16_t i = 0; i < gzip::hashSize; i++) this->head[i] = -1;
+      static const uint8_t header[10] = {0x1F, 0x8B, 8, 0, 0, 0, 0, 0, 0, 3};
+      memcpy(this->buffer, header, sizeof(header));
+      this->used = sizeof(header);
+      this->blockStart(false);
+    }
+    ~gzip() {
+      delete [] this->data;
+      delete [] this->head;
+    }
+    /*
+       Сжатие очередной порции данных
+    */
+    void write(const uint8_t *data, size_t size);
+    void write(const String &data) { this->write((const uint8_t *)data.c_str(), data.length()); }
+    /*
+       Завершение потока
+    */
+    void finish();
+
+    /* Статистика: принято байт, отдано байт, время сжатия в мкс, сжатие прекращено по бюджету */
+    uint32_t in = 0, total = 0, time = 0;
+    bool stored = false;
+
+  private:
+    void deflate(bool final);
+    void literal(uint8_t value);
+    void match(uint16_t length, uint16_t distance);
+    void code(uint16_t code, uint8_t bits);
+    void bits(uint32_t value, uint8_t count);
+    void align();
+    void put(uint8_t value);
+    void flush();
+    void blockStart(bool final);
+    void blockEnd();
+    void storedBlock(const uint8_t *data, uint16_t size, bool final);
+    uint16_t hash(const uint8_t *p) { return ((p[0] << 6) ^ (p[1] << 3) ^ p[2]) & (gzip::hashSize - 1); }
+
+    out_t out;
+    uint32_t budget;
+    uint8_t *data;             // Окно и необработанные данные
+    int16_t *head;             // Последняя позиция с таким хэшем
+    uint16_t fill = 0;         // Заполнено байт в data
+    uint16_t position = 0;     // Следующая кодируемая позиция в data
+    uint8_t buffer[gzip::bufferSize];
+    uint16_t used = 0;
+    uint32_t bitBuffer = 0;
+    uint8_t bitCount = 0;
+    uint32_t crc = 0xFFFFFFFF;
+};
+
+/*  */
+void gzip::write(const uint8_t *data, size_t size) {
+  /* CRC32 по полубайтам (таблица 16 слов) */
+  static const uint32_t table[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+  };
+  for (size_t i = 0; i < size; i++) {
+    this->crc ^= data[i];
+    this->crc = (this->crc >> 4) ^ table[this->crc & 15];
+    this->crc = (this->crc >> 4) ^ table[this->crc & 15];
+  }
+  this->in += size;
+
+  while (size) {
+    if (this->stored) {
+      size_t part = size > 0xFFFF ? 0xFFFF : size;
+      this->storedBlock(data, part, false);
+      data += part;
+      size -= part;
+      continue;
+    }
+    size_t part = gzip::window * 2 - this->fill;
+    if (part > size) part = size;
+    memcpy(this->data + this->fill, data, part);
+    this->fill += part;
+    data += part;
+    size -= part;
+
+    uint32_t start = micros();
+    this->deflate(false);
+    this->time += micros() - start;
+    if (this->time > this->budget) {
+      /* Бюджет исчерпан: дожимаем окно и переходим на несжатые блоки */
+      this->deflate(true);
+      this->blockEnd();
+      this->stored = true;
+    }
+  }
+}
+
+/*  */
+void gzip::deflate(bool final) {
+  while (this->position < this->fill) {
+    uint16_t available = this->fill - this->position;
+    if (!final and available < gzip::lookahead) break;
+    const uint8_t *p = this->data + this->position;
+    uint16_t length = 0, distance = 0;
+    if (available >= 3) {
+      uint16_t h = this->hash(p);
+      int16_t candidate = this->head[h];
+      this->head[h] = this->position;
+      if (candidate >= 0 and this->position - candidate <= gzip::window) {
+        const uint8_t *q = this->data + candidate;
+        uint16_t limit = available < gzip::lookahead ? available : gzip::lookahead;
+        while (length < limit and p[length] == q[length]) length++;
+        distance = this->position - candidate;
+      }
+    }
+    if (length >= 3) {
+      this->match(length, distance);
+      /* Хэши внутри совпадения (кроме последних позиций) для следующих поисков */
+      for (uint16_t i = 1; i < length and this->position + i + 3 <= this->fill; i++) {
+        this->head[this->hash(p + i)] = this->position + i;
+      }
+      this->position += length;
+    } else {
+      this->literal(*p);
+      this->position++;
+    }
+  }
+  /* Сдвиг окна */
+  if (this->position >= gzip::window * 2 - gzip::lookahead or (final and this->position > gzip::window)) {
+    uint16_t shift = this->position > gzip::window ? this->position - gzip::window : 0;
+    if (shift) {
+      memmove(this->data, this->data + shift, this->fill - shift);
+      this->fill -= shift;
+      this->position -= shift;
+      for (uint16_t i = 0; i < gzip::hashSize; i++) this->head[i] = this->head[i] >= (int16_t)shift ? this->head[i] - shift : -1;
+    }
+  }
+}
+
+/*  */
+void gzip::literal(uint8_t value) {
+  if (value < 144) this->code(0x30 + value, 8);
+  else this->code(0x190 + value - 144, 9);
+}
+
+/*  */
+void gzip::match(uint16_t length, uint16_t distance) {
+  static const uint16_t lengthBase[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+  static const uint8_t  lengthExtra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+  static const uint16_t distanceBase[20] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769};
+  static const uint8_t  distanceExtra[20] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8};
+
+  uint8_t l = 28;
+  while (lengthBase[l] > length) l--;
+  uint16_t symbol = 257 + l;
+  if (symbol < 280) this->code(symbol - 256, 7);
+  else this->code(0xC0 + symbol - 280, 8);
+  this->bits(length - lengthBase[l], lengthExtra[l]);
+
+  uint8_t d = 19;
+  while (distanceBase[d] > distance) d--;
+  this->code(d, 5);
+  this->bits(distance - distanceBase[d], distanceExtra[d]);
+}
+
+/* Коды Хаффмана записываются старшим битом вперед */
+void gzip::code(uint16_t code, uint8_t bits) {
+  uint16_t reversed = 0;
+  for (uint8_t i = 0; i < bits; i++, code >>= 1) reversed = (reversed << 1) | (code & 1);
+  this->bits(reversed, bits);
+}
+
+/*  */
+void gzip::bits(uint32_t value, uint8_t count) {
+  this->bitBuffer |= value << this->bitCount;
+  this->bitCount += count;
+  while (this->bitCount >= 8) {
+    this->put(this->bitBuffer);
+    this->bitBuffer >>= 8;
+    this->bitCount -= 8;
+  }
+}
+
+/*  */
+void gzip::align() {
+  if (this->bitCount) this->put(this->bitBuffer);
+  this->bitBuffer = 0;
+  this->bitCount = 0;
+}
+
+/*  */
+void gzip::put(uint8_t value) {
+  this->buffer[this->used++] = value;
+  if (this->used >= gzip::bufferSize) this->flush();
+}
+
+/*  */
+void gzip::flush() {
+  if (!this->used) return;
+  this->out(this->buffer, this->used);
+  this->total += this->used;
+  this->used = 0;
+}
+
+/*  */
+void gzip::blockStart(bool final) {
+  this->bits(final ? 1 : 0, 1);
+  this->bits(1, 2);  // Фиксированные коды
+}
+
+/*  */
+void gzip::blockEnd() {
+  this->code(0, 7);  // Конец блока (256)
+}
+
+/*  */
+void gzip::storedBlock(const uint8_t *data, uint16_t size, bool final) {
+  this->bits(final ? 1 : 0, 1);
+  this->bits(0, 2);
+  this->align();
+  this->put(size & 0xFF);
+  this->put(size >> 8);
+  this->put(~size & 0xFF);
+  this->put((~size >> 8) & 0xFF);
+  for (uint16_t i = 0; i < size; i++) this->put(data[i]);
+}
+
+/*  */
+void gzip::finish() {
+  if (this->stored) this->storedBlock(0, 0, true);
+  else {
+    uint32_t start = micros();
+    this->deflate(true);
+    this->time += micros() - start;
+    this->blockEnd();
+    this->blockStart(true);
+    this->blockEnd();
+  }
+  this->align();
+  uint32_t crc = ~this->crc;
+  for (uint8_t i = 0; i < 4; i++) this->put(crc >> (i * 8));
+  for (uint8_t i = 0; i < 4; i++) this->put(this->in >> (i * 8));
+  this->flush();
+}
+
+#endif
@@ -0,0 +1,253 @@
+#ifndef I2C_H
+#define I2C_H
+
+#include <Wire.h>
+#include "cron.h"
+
+typedef String json;
+
+/*
+   Менеджер шины i2c.
+    - настраиваемая частота шины (100 кГц или 400 кГц)
+    - проверка наличия устройства не чаще одного раза за цикл опроса, даже если на одном адресе несколько сенсоров
+    - восстановление зависшей шины (ведомый удерживает SDA после просадки питания): 9 тактов SCL и STOP
+    - счетчики транзакций, ошибок и времени по каждому адресу для API
+    - фоновое сканирование всей шины небольшими порциями из планировщика, с кэшированием результата
+*/
+class i2c {
+  public:
+    typedef enum { standard = 100000, fast = 400000 } speed_t;
+    /*
+       Инициализация шины
+    */
+    void begin(uint8_t sda, uint8_t scl, speed_t speed);
+    /*
+       Начало нового цикла опроса, сбрасывает кэш проверок наличия устройств
+    */
+    void cycle();
+    /*
+       Проверка наличия устройства на шине (результат кэшируется до следующего cycle())
+    */
+    bool probe(uint8_t address);
+    /*
+       Учет транзакции с устройством, выполненной сторонней библиотекой датчика
+    */
+    void account(uint8_t address, bool status, uint32_t time);
+    /*
+       Восстановление шины. Возвращает true если линия SDA освобождена.
+    */
+    bool recover();
+    /*
+       Линия SDA удерживается ведомым
+    */
+    bool stuck();
+    /*
+       Статистика по шине и адресам
+    */
+    json stats();
+    /*
+       Запуск фонового сканирования шины (если уже идет - ничего не делает)
+    */
+    void scan();
+    /*
+       Результат последнего завершенного сканирования: список найденных адресов (1 - ответил, 0 - ошибка),
+       возраст результата в ms (-1 если сканирования еще не было) и признак идущего сканирования.
+    */
+    json scanResult();
+
+  private:
+    struct stat_t {
+      stat_t(uint8_t address, stat_t *next): address(address), next(next) {}
+      uint8_t address;
+      uint32_t transactions = 0;
+      uint32_t errors = 0;
+      uint32_t time = 0;   // Суммарное время транзакций в мкс
+      uint32_t max = 0;    // Максимальное время транзакции в мкс
+      stat_t *next;
+    };
+    stat_t *find(uint8_t address);
+    /* Порция фонового сканирования, вызывается планировщиком */
+    void scanStep();
+    enum { scanPortion = 8 };   // Адресов за один вызов планировщика
+
+    stat_t *statList = 0;
+    uint32_t probed[4] = {0};   // Битовая карта адресов, проверенных в текущем цикле
+    uint32_t present[4] = {0};  // Битовая карта ответивших адресов
+    uint8_t sda = 4, scl = 5;
+    speed_t speed = standard;
+    uint32_t recoveries = 0;
+    uint32_t cycleTime = 0;     // Время шины в текущем цикле в мкс
+    uint32_t lastCycleTime = 0; // Время шины в предыдущем цикле в мкс
+    bool recovered = false;     // Восстановление уже выполнялось в текущем цикле
+    uint8_t scanAddress = 0;    // Следующий адрес сканирования (0 - сканирование не идет)
+    uint32_t scanFound[4] = {0}, scanFailed[4] = {0};   // Накопление идущего сканирования
+    uint32_t listFound[4] = {0}, listFailed[4] = {0};   // Результат последнего завершенного сканирования
+    uint32_t scanTime = 0;      // millis() завершения последнего сканирования
+    bool scanned = false;
+} i2c;
+
+/*  */
+void i2c::begin(uint8_t sda, uint8_t scl, speed_t speed = i2c::standard) {
+  this->sda = sda;
+  this->scl = scl;
+  this->speed = speed;
+  if (this->stuck()) this->recover();
+  Wire.begin(sda, scl);
+  Wire.setClock(speed);
+  if (!cron.find("i2cScan")) {
+    cron.add(50, [this](){ this->scanStep(); }, "i2cScan");
+    this->scan();
+  }
+}
+
+/*  */
+void i2c::cycle() {
+  memset(this->probed, 0, sizeof(this->probed));
+  this->lastCycleTime = this->cycleTime;
+  this->cycleTime = 0;
+  this->recovered = false;
+}
+
+/*  */
+bool i2c::probe(uint8_t address) {
+  uint32_t bit = 1UL << (address & 31);
+  if (this->probed[address >> 5] & bit) return this->present[address >> 5] & bit;
+
+  uint32_t start = micros();
+  Wire.beginTransmission(address);
+  byte status = Wire.endTransmission();
+  /* 2 - нет ответа на адрес (устройство отсутствует), остальное - ошибка шины */
+  if (status != 0 and status != 2 and !this->recovered and this->stuck()) {
+    this->recover();
+    Wire.beginTransmission(address);
+    status = Wire.endTransmission();
+  }
+  this->account(address, status == 0, micros() - start);
+
+  this->probed[address >> 5] |= bit;
+  if (status == 0) this->present[address >> 5] |= bit;
+  else this->present[address >> 5] &= ~bit;
+  return status == 0;
+}
+
+/*  */
+void i2c::account(uint8_t address, bool status, uint32_t time) {
+  stat_t *stat = this->find(address);
+  if (!stat) stat = this->statList = new stat_t(address, this->statList);
+  stat->transactions++;
+  if (!status) stat->errors++;
+  stat->time += time;
+  if (time > stat->max) stat->max = time;
+  this->cycleTime += time;
+}
+
+/*  */
+bool i2c::stuck() {
+  pinMode(this->sda, INPUT_PULLUP);
+  return digitalRead(this->sda) == LOW;
+}
+
+/*  */
+bool i2c::recover() {
+  #ifdef console
+    console.println(F("i2c: bus recovery"));
+  #endif
+  this->recovered = true;
+  this->recoveries++;
+  /* До 9 тактов SCL, пока ведомый не отпустит SDA (досылает оставшиеся биты байта) */
+  pinMode(this->sda, INPUT_PULLUP);
+  pinMode(this->scl, OUTPUT_OPEN_DRAIN);
+  for (byte i = 0; i < 9 and digitalRead(this->sda) == LOW; i++) {
+    digitalWrite(this->scl, LOW);
+    delayMicroseconds(5);
+    digitalWrite(this->scl, HIGH);
+    delayMicroseconds(5);
+  }
+  /* STOP: SDA из низкого в высокий при высоком SCL */
+  pinMode(this->sda, OUTPUT_OPEN_DRAIN);
+  digitalWrite(this->sda, LOW);
+  delayMicroseconds(5);
+  digitalWrite(this->scl, HIGH);
+  delayMicroseconds(5);
+  digitalWrite(this->sda, HIGH);
+  delayMicroseconds(5);
+  bool status = !this->stuck();
+  Wire.begin(this->sda, this->scl);
+  Wire.setClock(this->speed);
+  return status;
+}
+
+/*  */
+json i2c::stats() {
+  String list;
+  stat_t *stat = this->statList;
+  while (stat) {
+    String item;
+    item += "\"transactions\":" + String(stat->transactions) + ",";
+    item += "\"errors\":"       + String(stat->errors) + ",";
+    item += "\"avg\":"          + String(stat->transactions ? stat->time / stat->transactions : 0) + ",";
+    item += "\"max\":"          + String(stat->max);
+    if (list.length()) list += ",";
+    list += "\"" + String((stat->address < 16) ? "0" : "") + String(stat->address, HEX) + "\":{" + item + "}";
+    stat = stat->next;
+  }
+  String answer;
+  answer += "\"clock\":"      + String(this->speed) + ",";
+  answer += "\"recoveries\":" + String(this->recoveries) + ",";
+  answer += "\"cycleTime\":"  + String(this->lastCycleTime) + ",";
+  answer += "\"list\":{"      + list + "}";
+  return "{" + answer + "}";
+}
+
+/*  */
+void i2c::scan() {
+  if (this->scanAddress) return;
+  memset(this->scanFound, 0, sizeof(this->scanFound));
+  memset(this->scanFailed, 0, sizeof(this->scanFailed));
+  this->scanAddress = 1;
+}
+
+/*  */
+void i2c::scanStep() {
+  if (!this->scanAddress) return;
+  for (byte i = 0; i < i2c::scanPortion and this->scanAddress < 127; i++, this->scanAddress++) {
+    uint8_t address = this->scanAddress;
+    Wire.beginTransmission(address);
+    byte status = Wire.endTransmission();
+    if (!status) this->scanFound[address >> 5] |= 1UL << (address & 31);
+    else if (status == 4) this->scanFailed[address >> 5] |= 1UL << (address & 31);
+  }
+  if (this->scanAddress >= 127) {
+    memcpy(this->listFound, this->scanFound, sizeof(this->listFound));
+    memcpy(this->listFailed, this->scanFailed, sizeof(this->listFailed));
+    this->scanTime = millis();
+    this->scanned = true;
+    this->scanAddress = 0;
+  }
+}
+
+/*  */
+json i2c::scanResult() {
+  String answer;
+  for (byte address = 1; address < 127; address++) {
+    uint32_t bit = 1UL << (address & 31);
+    bool found = this->listFound[address >> 5] & bit;
+    if (found or this->listFailed[address >> 5] & bit) {
+      answer += answer.length() ? "," : "";
+      answer += "\"" + String((address < 16) ? "0" : "") + String(address, HEX) + "\":" + (found ? '1' : '0');
+    }
+  }
+  String age = this->scanned ? String(millis() - this->scanTime) : "-1";
+  return "{\"list\":{" + answer + "},\"age\":" + age + ",\"scanning\":" + (this->scanAddress ? "true" : "false") + "}";
+}
+
+/*  */
+i2c::stat_t *i2c::find(uint8_t address) {
+  stat_t *stat = this->statList;
+  while (stat) {
+    if (stat->address == address) return stat;
+    stat = stat->next;
+  } return 0;
+}
+
+#endif
@@ -0,0 +1,206 @@
+#ifndef LOGSTORE_H
+#define LOGSTORE_H
+
+/*
+   Сжатый журнал значений сенсора.
+   Значения квантуются с шагом индикатора (knob_t::step), хранятся разности соседних точек в zig-zag коде
+   адаптивным кодом Райса: код делится на 2^k, частное пишется в унарном виде (единицы и завершающий ноль),
+   остаток - k младшими битами. Параметр k подстраивается под среднюю величину последних кодов (как в LOCO-I),
+   поэтому плавный сигнал (температура с шагом 0.1) занимает 2-4 бита на точку, а быстрый (влажность
+   с шагом 0.01) - 6-8 бит без длинных служебных последовательностей. Частное от escape и больше означает,
+   что за escape единицами следует код целиком (32 бита) - для скачков после обрыва датчика.
+   Журнал разбит на блоки по 64 байта, каждый блок начинается с полного значения и начального k, поэтому
+   при заполнении целиком отбрасывается самый старый блок. Добавление точки O(1), чтение последовательное
+   от старых к новым.
+*/
+class logStore {
+  public:
+    struct block_t {
+      int32_t base;      // Первое значение блока в шагах квантования
+      uint16_t count;    // Количество точек в блоке
+      uint16_t used;     // Занято бит
+      uint8_t k;         // Параметр кода Райса на начало блока
+      uint8_t data[55];
+    };
+    enum { blockBits = sizeof(block_t::data) * 8 };
+    enum { escape = 24 };
+    /*
+       Оценка заполненности блока для планирования памяти: с шагом 0.1 суточные ряды занимают ~4 бита
+       на точку, с шагом 0.01 влажность - до 8.5 бит (tools/host/logstore_test.cpp)
+    */
+    static uint16_t blockPoints(const char *step) {
+      float value = step ? atof(step) : 0;
+      return value >= 0.1 or value <= 0 ? 100 : 50;
+    }
+    /*
+       Количество блоков для хранения не менее points точек с шагом step (плюс блок на вытеснение)
+    */
+    static uint16_t blocksFor(uint16_t points, const char *step) {
+      uint16_t size = logStore::blockPoints(step);
+      return points ? (points + size - 1) / size + 1 : 0;
+    }
+
+    logStore(const char *step, uint16_t blocks) {
+      this->step = step ? atof(step) : 0;
+      if (this->step <= 0) this->step = 0.01;
+      this->blocks = blocks ? blocks : 1;
+      this->block = new block_t[this->blocks]{};
+    }
+    /*
+       Добавление точки
+    */
+    void push(float value);
+    /*
+       Последовательное чтение last последних точек (от старых к новым)
+    */
+    void read(uint16_t last, std::function<void(float)> fn);
+    /*
+       Количество точек в журнале
+    */
+    uint16_t size() { return this->count; }
+    /*
+       Объем памяти журнала в байтах и размер сериализованного состояния
+    */
+    size_t bytes() { return sizeof(head_t) + this->blocks * sizeof(block_t); }
+    uint16_t capacity() { return this->blocks; }
+    /*
+       Сериализация состояния (для сохранения перед плановой перезагрузкой) и восстановление из буфера bytes() байт
+    */
+    void serialize(std::function<void(const void *, size_t)> out);
+    void deserialize(const uint8_t *buffer);
+
+  private:
+    /* Состояние адаптации кода Райса: сумма и количество последних кодов */
+    struct rice_t {
+      uint32_t sum;
+      uint32_t samples;
+      void reset(uint8_t k) { this->sum = 4UL << k; this->samples = 4; }
+      uint8_t k() {
+        uint8_t k = 0;
+        while (k < logStore::escape and (this->samples << k) < this->sum) k++;
+        return k;
+      }
+      void update(uint32_t code) {
+        this->sum += code < (1UL << logStore::escape) ? code : (1UL << logStore::escape);
+        if (++this->samples >= 32) {
+          this->sum >>= 1;
+          this->samples >>= 1;
+        }
+      }
+    };
+    struct head_t {
+      uint16_t first;    // Индекс самого старого блока
+      uint16_t used;     // Количество занятых блоков
+      int32_t previous;  // Последнее добавленное значение в шагах квантования
+      rice_t rice;       // Состояние кодера последнего блока
+    } head = {0, 0, 0, {4, 4}};
+    bool put(block_t *block, uint32_t code);
+    bool bit(const block_t *block, uint16_t index) { return block->data[index >> 3] & (1 << (index & 7)); }
+
+    float step;
+    uint16_t blocks;
+    uint16_t count = 0;
+    block_t *block;
+};
+
+/*  */
+void logStore::push(float value) {
+  float q = value / this->step;
+  int32_t current = isnan(q) ? 0 : q > 1e9 ? 1000000000 : q < -1e9 ? -1000000000 : lroundf(q);
+  block_t *last = this->head.used ? &this->block[(this->head.first + this->head.used - 1) % this->blocks] : 0;
+
+  if (last) {
+    int32_t delta = current - this->head.previous;
+    uint32_t code = ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31);
+    if (this->put(last, code)) {
+      this->head.rice.update(code);
+      last->count++;
+      this->count++;
+      this->head.previous = current;
+      return;
+    }
+  }
+  /* Новый блок, при заполнении журнала вытесняется самый старый */
+  if (this->head.used >= this->blocks) {
+    this->count -= this->block[this->head.first].count;
+    this->head.first = (this->head.first + 1) % this->blocks;
+    this->head.used--;
+  }
+  last = &this->block[(this->head.first + this->head.used++) % this->blocks];
+  memset(last, 0, sizeof(block_t));
+  last->base = current;
+  last->count = 1;
+  last->k = this->head.rice.k();
+  this->head.rice.reset(last->k);
+  this->count++;
+  this->head.previous = current;
+}
+
+/*  */
+bool logStore::put(block_t *block, uint32_t code) {
+  uint8_t k = this->head.rice.k();
+  uint32_t quotient = code >> k;
+  uint8_t size = quotient < logStore::escape ? quotient + 1 + k : logStore::escape + 32;
+  if (block->used + size > logStore::blockBits) return false;
+  /* Блок обнулен при создании, пишутся только единицы */
+  auto one = [&](uint16_t index) { block->data[index >> 3] |= 1 << (index & 7); };
+  if (quotient < logStore::escape) {
+    for (uint32_t i = 0; i < quotient; i++) one(block->used++);
+    block->used++;
+  } else {
+    for (uint8_t i = 0; i < logStore::escape; i++) one(block->used++);
+    k = 32;
+  }
+  for (uint8_t i = 0; i < k; i++, block->used++)
+    if (code & (1UL << i)) one(block->used);
+  return true;
+}
+
+/*  */
+void logStore::read(uint16_t last, std::function<void(float)> fn) {
+  uint16_t skip = last < this->count ? this->count - last : 0;
+  for (uint16_t b = 0; b < this->head.used; b++) {
+    const block_t *block = &this->block[(this->head.first + b) % this->blocks];
+    /* Блок целиком до начала диапазона не декодируется */
+    if (skip >= block->count) {
+      skip -= block->count;
+      continue;
+    }
+    int32_t value = block->base;
+    uint16_t index = 0;
+    rice_t rice;
+    rice.reset(block->k);
+    for (uint16_t n = 0; n < block->count; n++) {
+      if (n) {
+        uint8_t k = rice.k(), quotient = 0;
+        while (quotient < logStore::escape and this->bit(block, index++)) quotient++;
+        uint32_t code = 0;
+        if (quotient == logStore::escape) k = 32;
+        else code = (uint32_t)quotient << k;
+        for (uint8_t i = 0; i < k; i++)
+          if (this->bit(block, index++)) code |= 1UL << i;
+        rice.update(code);
+        value += (int32_t)(code >> 1) ^ -(int32_t)(code & 1);
+      }
+      if (skip) skip--;
+      else fn(value * this->step);
+    }
+  }
+}
+
+/*  */
+void logStore::serialize(std::function<void(const void *, size_t)> out) {
+  out(&this->head, sizeof(this->head));
+  out(this->block, this->blocks * sizeof(block_t));
+}
+
+/*  */
+void logStore::deserialize(const uint8_t *buffer) {
+  memcpy(&this->head, buffer, sizeof(this->head));
+  memcpy(this->block, buffer + sizeof(this->head), this->blocks * sizeof(block_t));
+  if (this->head.first >= this->blocks or this->head.used > this->blocks) this->head = {0, 0, 0, {4, 4}};
+  this->count = 0;
+  for (uint16_t b = 0; b < this->head.used; b++) this->count += this->block[(this->head.first + b) % this->blocks].count;
+}
+
+#endif
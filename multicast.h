@@ -0,0 +1,136 @@
+#ifndef MULTICAST_H
+#define MULTICAST_H
+
+#include <WiFiUdp.h>
+#include "config.h"
+#include "wifi.h"
+#include "sensors.h"
+#include "ds3231.h"
+
+/*
+   Двоичная рассылка показаний в локальную сеть по UDP multicast (вместо опроса /api/sensors).
+   Включается параметром конфигурации multicast_group (например 239.0.0.57), порт 4211.
+   После каждого цикла сбора данных отправляется одна датаграмма данных (little-endian):
+     'WSD1', uint32 chipId, uint32 номер пакета, uint32 время (местное, секунды с 1970 или 0), uint32 номер схемы,
+     uint8 количество, далее float значения в порядке списка сенсоров
+   Схема (соответствие индексов именам и единицам) отправляется при старте, при изменении состава сенсоров
+   и раз в schemaPeriod датаграмм данных, при большом числе сенсоров - несколькими датаграммами:
+     'WSS1', uint32 chipId, uint32 номер схемы, uint8 первый индекс, uint8 количество,
+     далее по каждому сенсору uint8 длина, имя, uint8 длина, единица измерения
+   Номер схемы - хэш имен сенсоров, по нему получатель сопоставляет данные и схему.
+*/
+class multicast {
+  public:
+    enum {
+      port = 4211,
+      schemaPeriod = 12,  // Датаграмм данных между повторами схемы (минута при сборе раз в 5 секунд)
+      packetSize = 512
+    };
+    /*
+       Запуск в соответствии с конфигурацией, вызывается в setup() после регистрации сенсоров
+    */
+    void begin();
+
+  private:
+    /* Отправка датаграммы данных (и схемы при необходимости) */
+    void send();
+    void sendSchema();
+    uint32_t schemaId();
+    void transmit(const uint8_t *data, size_t size);
+
+    WiFiUDP udp;
+    IPAddress group;
+    uint32_t sequence = 0;
+    uint32_t schema = 0;
+    uint8_t countdown = 0;
+} multicast;
+
+/*  */
+void multicast::begin() {
+  if (!this->group.fromString(conf.param("multicast_group")) or !this->group.isMulticast()) return;
+  sensors.onUpdate([this](){ this->send(); });
+  #ifdef console
+    console.printf("multicast: %s:%d\n", this->group.toString().c_str(), multicast::port);
+  #endif
+}
+
+/*  */
+void multicast::send() {
+  if (!wifi.transferDataPossible()) return;
+  uint32_t schema = this->schemaId();
+  if (schema != this->schema or !this->countdown) {
+    this->schema = schema;
+    this->countdown = multicast::schemaPeriod;
+    this->sendSchema();
+  }
+  this->countdown--;
+
+  uint8_t packet[multicast::packetSize];
+  uint32_t chip = ESP.getChipId(), time = ds3231.now();
+  this->sequence++;
+  memcpy(packet, "WSD1", 4);
+  memcpy(packet + 4, &chip, 4);
+  memcpy(packet + 8, &this->sequence, 4);
+  memcpy(packet + 12, &time, 4);
+  memcpy(packet + 16, &schema, 4);
+  size_t size = 21;
+  uint8_t count = 0;
+  sensors.each([&](device *sensor) {
+    if (size + 4 > sizeof(packet)) return;
+    float value = sensor->lastDimension;
+    memcpy(packet + size, &value, 4);
+    size += 4;
+    count++;
+  });
+  packet[20] = count;
+  this->transmit(packet, size);
+}
+
+/*  */
+void multicast::sendSchema() {
+  uint8_t packet[multicast::packetSize];
+  uint32_t chip = ESP.getChipId();
+  memcpy(packet, "WSS1", 4);
+  memcpy(packet + 4, &chip, 4);
+  memcpy(packet + 8, &this->schema, 4);
+  size_t size = 14;
+  uint8_t index = 0, first = 0;
+  sensors.each([&](device *sensor) {
+    const char *unit = sensor->knob->unit ? sensor->knob->unit : "";
+    uint8_t name = strnlen(sensor->name, 255), units = strnlen(unit, 255);
+    /* Датаграмма заполнена - отправляем и начинаем следующую с текущего индекса */
+    if (size + 2 + name + units > sizeof(packet)) {
+      packet[12] = first;
+      packet[13] = index - first;
+      this->transmit(packet, size);
+      first = index;
+      size = 14;
+    }
+    packet[size++] = name;
+    memcpy(packet + size, sensor->name, name);
+    size += name;
+    packet[size++] = units;
+    memcpy(packet + size, unit, units);
+    size += units;
+    index++;
+  });
+  packet[12] = first;
+  packet[13] = index - first;
+  this->transmit(packet, size);
+}
+
+/* FNV-1a по именам сенсоров в порядке списка, после каждого имени разделитель 0xFF */
+uint32_t multicast::schemaId() {
+  uint32_t hash = fnv1a("");
+  sensors.each([&](device *sensor) { hash = fnv1a("\xFF", fnv1a(sensor->name, hash)); });
+  return hash;
+}
+
+/*  */
+void multicast::transmit(const uint8_t *data, size_t size) {
+  this->udp.beginPacketMulticast(this->group, multicast::port, WiFi.localIP());
+  this->udp.write(data, size);
+  this->udp.endPacket();
+}
+
+#endif
@@ -0,0 +1,213 @@
+#ifndef PULSE_H
+#define PULSE_H
+
+#include "tools.h"
+#include "cron.h"
+#include "sensors.h"
+
+/*
+   Подсистема импульсных входов: анемометры, опрокидывающиеся осадкомеры, расходомеры и т.п.
+   Каждый канал - отдельный GPIO с прерыванием, подавлением дребезга по минимальному интервалу между импульсами
+   и счетчиком, который только растет (пишет прерывание, читает основной цикл, блокировки не нужны).
+   Для канала автоматически регистрируются два сенсора:
+    - <name>       - частота импульсов, умноженная на rateScale (например м/с, л/мин, мм/ч). Считается по интервалу
+                     от последнего импульса предыдущего расчета до последнего импульса текущего, а не по секундному
+                     окну: одно опрокидывание осадкомера не дает 1000 мм/ч. Без импульсов частота не выше одного
+                     импульса за прошедшее время и обнуляется через rateTimeout, интервал не длиннее rateTimeout.
+    - <name>_total - накопленное количество импульсов, умноженное на totalScale (например мм осадков, литры)
+   Накопленные итоги хранятся в RTC памяти и переживают программную перезагрузку.
+   При необходимости канал ведет кольцевой буфер меток времени импульсов (micros(), ring > 0, степень двойки),
+   который разбирает пользовательский код через pop() - например для расчета порывов ветра.
+
+   knob_t *R = new knob_t(0, 100, ".1", "Осадки", "мм/ч");
+   knob_t *A = new knob_t(0, 1000, ".1", "Осадки", "мм");
+   pulse.add(12, "rain", R, 0.2794 * 3600, A, 0.2794, 50000); // 0.2794 мм на опрокидывание, дребезг геркона до 50 ms
+*/
+class pulseChannel {
+  public:
+    pulseChannel(uint8_t pin, const char *name, float rateScale, float totalScale, uint32_t spacing, uint16_t ring, pulseChannel *next) {
+      this->pin = pin;
+      this->name = name;
+      this->rateScale = rateScale;
+      this->totalScale = totalScale;
+      this->spacing = spacing;
+      this->ringSize = ring;
+      this->ring = ring ? new uint32_t[ring]{0} : 0;
+      this->next = next;
+    }
+    /* Извлечение метки времени (micros()) из кольцевого буфера, false если буфер пуст */
+    bool pop(uint32_t &stamp) {
+      if (this->ringTail == this->ringHead) return false;
+      stamp = this->ring[this->ringTail];
+      this->ringTail = (this->ringTail + 1) & (this->ringSize - 1);
+      return true;
+    }
+
+    uint8_t pin;
+    const char *name;
+    float rateScale, totalScale;
+    uint32_t spacing;               // Минимальный интервал между импульсами в микросекундах
+    volatile uint32_t count = 0;    // Принятые импульсы (только растет)
+    volatile uint32_t bounce = 0;   // Отброшенные как дребезг
+    volatile uint32_t last = 0;     // Метка времени последнего принятого импульса (micros())
+    volatile uint32_t lastMillis = 0; // То же по millis(): интервал длиннее переполнения micros() - не дребезг
+    volatile uint32_t *ring;
+    uint16_t ringSize;
+    volatile uint16_t ringHead = 0;
+    volatile uint16_t ringTail = 0;
+    volatile uint32_t ringLost = 0; // Импульсы, не поместившиеся в кольцевой буфер
+    uint32_t seen = 0;              // Значение счетчика на момент последнего расчета
+    uint32_t total = 0;             // Накопленный итог с учетом значения из RTC памяти
+    uint32_t stamp = 0;             // Метка последнего импульса на момент последнего расчета (micros())
+    uint32_t active = 0;            // millis() расчета, в котором были импульсы (0 - импульсов не было дольше rateTimeout)
+    float rate = 0;
+    pulseChannel *next;
+};
+
+class pulse {
+  public:
+    /* Максимальное количество каналов (определяет размер области в RTC памяти) */
+    enum { channels = 4 };
+    /* Без импульсов дольше rateTimeout частота обнуляется, он же - предел интервала для первого импульса */
+    enum { rateTimeout = cron::time_15m };
+    pulse() { this->rtc = rtcMemory.reserve(sizeof(this->totals)); }
+    /*
+       Добавление канала
+       Необходимо передать:
+        - GPIO
+        - имя канала (уникальное, используется как имя сенсора частоты)
+        - параметры индикатора частоты и множитель частоты (0 - сенсор не регистрируется)
+        - параметры индикатора итога и множитель итога (0 - сенсор не регистрируется)
+        - минимальный интервал между импульсами в микросекундах (подавление дребезга)
+        - размер кольцевого буфера меток времени (0 - без буфера)
+        - фронт срабатывания прерывания
+       Возвращает указатель на канал или 0.
+    */
+    pulseChannel *add(uint8_t pin, const char *name, knob_t *rate, float rateScale, knob_t *total, float totalScale, uint32_t spacing, uint16_t ring, int mode);
+    /*
+       Поиск канала по имени
+    */
+    pulseChannel *find(const char *name);
+    /*
+       Пересчет частоты и итогов по всем каналам, сохранение итогов в RTC память.
+       Вызывается планировщиком автоматически.
+    */
+    void update();
+    /*
+       Сброс накопленного итога канала
+    */
+    void reset(const char *name);
+
+  private:
+    static void ICACHE_RAM_ATTR detected(void *arg);
+    pulseChannel *channelList = 0;
+    uint8_t size = 0;
+    int rtc = -1;
+    uint32_t totals[channels] = {0};
+    uint32_t time = 0;
+} pulse;
+
+/* Обработчик прерывания: подавление дребезга, счетчик и кольцевой буфер */
+void ICACHE_RAM_ATTR pulse::detected(void *arg) {
+  pulseChannel *channel = (pulseChannel *)arg;
+  uint32_t now = micros(), ms = millis();
+  if (channel->count and now - channel->last < channel->spacing and ms - channel->lastMillis < cron::time_1s + channel->spacing / 1000) {
+    ++channel->bounce;
+    return;
+  }
+  channel->last = now;
+  channel->lastMillis = ms;
+  ++channel->count;
+  if (channel->ring) {
+    uint16_t next = (channel->ringHead + 1) & (channel->ringSize - 1);
+    if (next == channel->ringTail) ++channel->ringLost;
+    else {
+      channel->ring[channel->ringHead] = now;
+      channel->ringHead = next;
+    }
+  }
+}
+
+/*  */
+pulseChannel *pulse::add(uint8_t pin, const char *name, knob_t *rate, float rateScale, knob_t *total = 0, float totalScale = 0, uint32_t spacing = 0, uint16_t ring = 0, int mode = FALLING) {
+  if (this->find(name) or this->size >= pulse::channels) return 0;
+  if (ring & (ring - 1)) return 0; // размер буфера должен быть степенью двойки
+
+  pulseChannel *channel = new pulseChannel(pin, name, rateScale, totalScale, spacing, ring, this->channelList);
+  this->channelList = channel;
+
+  /* Восстановление итогов после программной перезагрузки */
+  if (!this->size and !rtcMemory.read(this->rtc, this->totals, sizeof(this->totals))) memset(this->totals, 0, sizeof(this->totals));
+  channel->total = this->totals[this->size++];
+
+  pinMode(pin, INPUT_PULLUP);
+  attachInterruptArg(pin, pulse::detected, channel, mode);
+
+  if (rate) sensors.add(rate, device::out, name, [channel](){ return channel->rate; });
+  if (total) {
+    String totalName = String(name) + "_total";
+    sensors.add(total, device::out, strdup(totalName.c_str()), [channel](){ return channel->total * channel->totalScale; });
+  }
+  if (!cron.find("pulseUpdate")) {
+    this->time = millis();
+    cron.add(cron::time_1s, [this](){ this->update(); }, "pulseUpdate", cron::high);
+  }
+  return channel;
+}
+
+/*  */
+pulseChannel *pulse::find(const char *name) {
+  pulseChannel *channel = this->channelList;
+  while (channel) {
+    if (!strcmp(channel->name, name)) return channel;
+    channel = channel->next;
+  } return 0;
+}
+
+/*  */
+void pulse::update() {
+  uint32_t now = millis();
+  float time = (now - this->time) * 0.001;
+  this->time = now;
+  if (time <= 0) return;
+
+  uint8_t i = this->size;
+  pulseChannel *channel = this->channelList;
+  while (channel) {
+    uint32_t stamp = channel->last;
+    uint32_t count = channel->count;
+    uint32_t pulses = count - channel->seen;
+    channel->seen = count;
+    channel->total += pulses;
+    if (pulses) {
+      /* Интервал от последнего импульса прошлого расчета (не длиннее rateTimeout, micros() за это время не переполняется) */
+      float interval = channel->active ? (stamp - channel->stamp) * 0.000001 : pulse::rateTimeout * 0.001;
+      if (interval > pulse::rateTimeout * 0.001) interval = pulse::rateTimeout * 0.001;
+      if (interval < time) interval = time;
+      channel->rate = pulses / interval * channel->rateScale;
+      channel->stamp = stamp;
+      channel->active = now ? now : 1;
+    } else if (channel->active) {
+      /* Импульсов нет: частота не больше одного импульса за время с последнего */
+      uint32_t silence = now - channel->active;
+      if (silence >= pulse::rateTimeout) {
+        channel->active = 0;
+        channel->rate = 0;
+      } else if (silence) channel->rate = min(channel->rate, channel->rateScale * 1000 / silence);
+    }
+    this->totals[--i] = channel->total;
+    channel = channel->next;
+  }
+  rtcMemory.write(this->rtc, this->totals, sizeof(this->totals));
+}
+
+/*  */
+void pulse::reset(const char *name) {
+  pulseChannel *channel = this->find(name);
+  if (channel) {
+    channel->total = 0;
+    this->update();
+  }
+}
+
+#endif
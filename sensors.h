@@ -2,7 +2,11 @@
 #define SENSOR_H
 
 #include <base64.h>
+#include "storage.h"
 #include "tools.h";
+#include "cron.h"
+#include "i2c.h"
+#include "logstore.h"
 
 typedef String json;
 
@@ -24,14 +28,14 @@ class device {
     typedef std::function<void(void)> initFn_t;
     typedef std::function<float(void)> dataFn_t;
     
-    device(knob_t *knob, list_t list, byte address, const char *name, initFn_t init, dataFn_t data, byte log, device *next) {
+    device(knob_t *knob, list_t list, byte address, const char *name, initFn_t init, dataFn_t data, uint16_t log, device *next) {
       this->knob = knob;
       this->list = list;
       this->address = address;
       this->name = name;
       this->init = init;
       this->data = data;
-      this->log  = log ? new float[log]{0} : 0;
+      this->logDepth = log;
       this->next = next;
     }
     device(list_t *list) {}
@@ -44,13 +48,26 @@ class device {
     dataFn_t data;
     bool status = false;
     medianFilter_t lastDimension;
-    float *log;
-    byte logPosition = 0;
+    logStore *log = 0;         // Журнал, создается планировщиком памяти sensors.logPlan()
+    uint32_t logInterval = cron::time_10m;
+    uint16_t logDepth = 0;     // Запрошенная глубина журнала в точках (0 - журнал не ведется)
     device *next;
+
+    /* Входы программного сенсора (имена и найденные по ним сенсоры) */
+    const char **inputs = 0;
+    device **sources = 0;
+    byte inputsCount = 0;
+    bool changed = false;   // Отфильтрованное значение изменилось в последнем цикле сбора данных
+    bool computed = false;  // Значение хотя бы раз рассчитано
+    bool remote = false;    // Сенсор другой станции (collector.h), состояние не сохраняется между перезагрузками
+
+    /* Значение опрашивается: датчик на шине найден, расчетный сенсор или сенсор станции, от которой идут данные */
+    bool readable() { return this->status or (this->address == 0x00 and !this->remote); }
 };
 
 class sensors {    
   public:
+    sensors() { this->rtc = rtcMemory.reserve(sizeof(snapshot_t)); }
     /*
        Добавление нового датчика в список
        Необходимо передать:
@@ -82,6 +99,38 @@ class sensors {
     bool add(knob_t *knob, device::list_t list, const char *name, device::dataFn_t data, bool log);
 
     bool add(knob_t *knob, const char *name, device::dataFn_t data, bool log);
+
+    /*
+       Объявление входов программного (расчетного) сенсора.
+       Сенсоры с объявленными входами рассчитываются после своих входов в том же цикле сбора данных
+       и пропускают расчет, если ни один из входов не изменился.
+       
+        sensors.add(DP, device::out, "out_dewPoint", [&](){ return dewPoint(sensors.get("out_temperature"), sensors.get("out_humidity")); });
+        sensors.depends("out_dewPoint", {"out_temperature", "out_humidity"});
+    */
+    bool depends(const char *name, std::initializer_list<const char *> inputs);
+
+    /*
+       Интервал и глубина журнала сенсора (по умолчанию 10 минут и неделя для сенсоров с включенным логом).
+       Глубина 0 отключает журнал. Вызывается в sensors_config() после регистрации сенсора.
+       Web интерфейс строит графики с шагом 10 минут, другие интервалы доступны через API.
+
+        sensors.logConfig("windGust", cron::time_1m, 1440);        // сутки с шагом 1 минута
+        sensors.logConfig("out_pressure", cron::time_30m, 1344);   // 4 недели с шагом 30 минут
+    */
+    bool logConfig(const char *name, uint32_t interval, uint16_t depth);
+    /*
+       Планирование памяти журналов: сумма запрошенных журналов сверяется со свободной памятью,
+       при нехватке глубина всех журналов пропорционально уменьшается. Создает журналы и задания
+       в планировщике на каждый интервал (для 10 минут - httpSensorsLog).
+       Вызывается один раз после sensors_config(), распределение выводится в /api/sensors/structure.
+    */
+    void logPlan();
+
+    /*
+       Функция, вызываемая после каждого полного цикла сбора данных (рассылка показаний, публикация)
+    */
+    void onUpdate(std::function<void(void)> fn);
     
     /*
        Ищет объект сенсора по его имени
@@ -109,12 +158,32 @@ class sensors {
     json get(bool edging);
 
     /*
-       Возвращает суточный лог сенсора
+       Возвращает суточный лог сенсора (последние logSize точек). Без имени - все сенсоры с основным
+       10-минутным журналом и общим timeAdjustment, журналы с другим шагом выдаются только по имени
     */
     json log(device *sensor);
     json log(const char *name);
     json log();
 
+    /*
+       Потоковая выдача прореженного лога без построения полного ряда в памяти.
+       last   - количество последних точек журнала (диапазон), 0 - весь журнал
+       points - наибольшее количество точек в ответе (огибающая min/max: по две точки на интервал, нечетное
+                округляется вниз, не меньше 2), 0 - без прореживания
+       name   - имя сенсора или 0 для всех сенсоров с журналом
+       Ответ передается порциями в функцию out:
+        {"timeAdjustment":..., "interval":..., "bucket":..., "bucketInterval":..., "sensor":[min,max,min,max,...], ...}
+       где interval - шаг журнала в ms (сенсора name, для всех сенсоров - 10 минут, остальные шаги в "intervals"),
+       bucket - количество точек журнала, свернутых в одну пару min/max (1 - ряд без прореживания),
+       bucketInterval - время, которое покрывает одна пара, в ms (interval * bucket).
+    */
+    void log(const char *name, uint16_t last, uint16_t points, std::function<void(const String &)> out);
+
+    /*
+       Последовательное чтение last последних точек журнала сенсора (от старых к новым)
+    */
+    void logRead(device *sensor, uint16_t last, std::function<void(float)> fn);
+
     /*
        Производит обновление лога
        Обновляет лог конкретного сенсора если передано его имя или указатель на него
@@ -123,6 +192,8 @@ class sensors {
     void logUpdate(device *sensor);
     void logUpdate(const char *name);
     void logUpdate();
+    /* Обновление журналов сенсоров с заданным интервалом */
+    void logUpdate(uint32_t interval);
 
     /*
        Производит обновление данных
@@ -145,6 +216,37 @@ class sensors {
        Возвращает полное описание всех сенсоров в системе
     */
     json list(bool edging);
+
+    /*
+       Обход всех сенсоров в порядке списка
+    */
+    void each(std::function<void(device *)> fn);
+
+    /*
+       Сохранение состояния перед плановой перезагрузкой (перезагрузка через API, OTA обновление):
+       журналы записываются во flash память, отметка о них и значения фильтров - в RTC память.
+       Значения фильтров, кроме того, сохраняются в RTC память после каждого сбора данных, поэтому
+       переживают и внеплановую перезагрузку (watchdog, исключение).
+    */
+    void save();
+    /*
+       Восстановление состояния после программной перезагрузки.
+       Вызывается после регистрации всех сенсоров. Данные принимаются только если совпадает набор сенсоров
+       и контрольные суммы, файл журналов удаляется после чтения.
+       Возвращает true если были восстановлены значения фильтров.
+    */
+    bool restore();
+
+    /*
+       Поколение данных: увеличивается при каждом изменении значений (dataUpdate) и журналов (logUpdate).
+       Используется web сервером для кэширования ответов и ETag.
+    */
+    uint32_t generation = 1;
+    /*
+       Поколение состава сенсоров: увеличивается только при добавлении сенсоров и создании журналов
+       (структура для web интерфейса).
+    */
+    uint32_t structure = 1;
     
   private:
     /*
@@ -153,15 +255,70 @@ class sensors {
     */
     String clear(float value);
 
+    /*
+       Сохранение значений фильтров в RTC память
+    */
+    void snapshot();
+    /*
+       Контрольная сумма набора сенсоров, чтобы не восстановить чужое состояние после смены прошивки
+    */
+    uint32_t layout();
+    /*
+       Построение порядка сбора данных: порядок регистрации, но каждый сенсор после своих входов
+    */
+    void sort();
+
+    device **order = 0;
+    byte orderSize = 0;
+
     device *sensorsList = 0;
-    byte logSize = 144;
+    byte logSize = 144;        // Точек журнала в ответе по умолчанию (сутки с шагом 10 минут, ожидает web интерфейс)
+    uint16_t logDepth = 1008;  // Глубина журнала по умолчанию (неделя с шагом 10 минут)
+    uint32_t logReserve = 16384; // Свободная память, которую планировщик журналов оставляет web серверу и сервисам
+
+    /* Задания планировщика по интервалам журналов */
+    struct logGroup_t {
+      uint32_t interval;
+      const char *id;
+      logGroup_t *next;
+    };
+    logGroup_t *logGroups = 0;
+    bool planned = false;
+    /* Создание журнала сенсора и задания его обновления */
+    void logAttach(device *sensor, uint16_t blocks);
+
+    struct hook_t {
+      std::function<void(void)> fn;
+      hook_t *next;
+    };
+    hook_t *updateHooks = 0;
+    /* Идентификатор задания журнала с заданным интервалом */
+    const char *logId(uint32_t interval);
+
+    /* Состояние в RTC памяти */
+    enum { snapshotSize = 12 };
+    struct snapshot_t {
+      uint32_t layout;
+      uint32_t history;              // CRC файла журналов, записанного перед плановой перезагрузкой (0 - нет)
+      float value[snapshotSize];
+    };
+    int rtc = -1;
+    uint32_t history = 0;
+    const char *historyFile = "/history.bin";
 } sensors;
 
 /* */
 bool sensors::add(knob_t *knob, device::list_t list, byte address, const char *name, device::initFn_t init, device::dataFn_t data, bool log = false) {
   if (!this->find(name)) {
-    device *sensor = new device(knob, list, address, name, init, data, log ? this->logSize : 0, this->sensorsList);
+    device *sensor = new device(knob, list, address, name, init, data, log ? this->logDepth : 0, this->sensorsList);
     this->sensorsList = sensor;
+    this->orderSize = 0;
+    this->structure++;
+    /* Сенсор добавлен после планирования журналов: журнал создается, только если хватает памяти */
+    if (this->planned and sensor->logDepth) {
+      uint16_t blocks = logStore::blocksFor(sensor->logDepth, sensor->knob->step);
+      if (ESP.getFreeHeap() > this->logReserve + blocks * sizeof(logStore::block_t)) this->logAttach(sensor, blocks);
+    }
 
     return true;
   } return false;
@@ -188,6 +345,52 @@ bool sensors::add(knob_t *knob, const char *name, device::dataFn_t data, bool lo
   return this->add(knob, device::out, 0x00, name, [](){}, data, log);
 }
 
+/*  */
+bool sensors::depends(const char *name, std::initializer_list<const char *> inputs) {
+  device *sensor = this->find(name);
+  if (!sensor or !inputs.size()) return false;
+  delete [] sensor->inputs;
+  delete [] sensor->sources;
+  sensor->inputsCount = inputs.size();
+  sensor->inputs = new const char *[sensor->inputsCount];
+  sensor->sources = new device *[sensor->inputsCount]{0};
+  std::copy(inputs.begin(), inputs.end(), sensor->inputs);
+  this->orderSize = 0;
+  return true;
+}
+
+/*  */
+void sensors::sort() {
+  /* Порядок регистрации (список хранится в обратном порядке) */
+  byte size = 0;
+  this->each([&](device *sensor) { size++; });
+  delete [] this->order;
+  this->order = new device *[size];
+  device *registered[size];
+  byte i = size;
+  this->each([&](device *sensor) {
+    registered[--i] = sensor;
+    for (byte n = 0; n < sensor->inputsCount; n++) sensor->sources[n] = this->find(sensor->inputs[n]);
+  });
+  /* Топологическая сортировка: на каждом шаге первый по регистрации сенсор, все входы которого уже размещены */
+  bool placed[size];
+  memset(placed, 0, sizeof(placed));
+  auto ready = [&](device *sensor) {
+    for (byte n = 0; n < sensor->inputsCount; n++) {
+      if (!sensor->sources[n]) continue;
+      for (byte k = 0; k < size; k++) if (registered[k] == sensor->sources[n] and !placed[k]) return false;
+    } return true;
+  };
+  for (this->orderSize = 0; this->orderSize < size;) {
+    byte next = size;
+    for (byte k = 0; k < size and next == size; k++) if (!placed[k] and ready(registered[k])) next = k;
+    /* Циклическая зависимость - размещаем первый оставшийся, чтобы не зависнуть */
+    if (next == size) for (byte k = 0; k < size and next == size; k++) if (!placed[k]) next = k;
+    placed[next] = true;
+    this->order[this->orderSize++] = registered[next];
+  }
+}
+
 /*  */
 device *sensors::find(const char *name) {
   if (this->sensorsList) {
@@ -263,12 +466,9 @@ json sensors::log(device *sensor) {
   String log;
   if (sensor) {
     if (sensor->log) {
-      for (byte i = sensor->logPosition; i < this->logSize; i++) {
-        log += (log.length() ? "," : "") + this->clear(sensor->log[i]);
-      }
-      for (byte i = 0; i < sensor->logPosition; i++) {
-        log += (log.length() ? "," : "") + this->clear(sensor->log[i]);
-      }
+      this->logRead(sensor, this->logSize, [&](float value) {
+        log += (log.length() ? "," : "") + this->clear(value);
+      });
       if (log.length()) log = "\"" + String(sensor->name) + "\":[" + log + "]";
     }
   } return log;
@@ -276,8 +476,9 @@ json sensors::log(device *sensor) {
 
 /*  */
 json sensors::log(const char *name) {
-  String log = this->log(this->find(name));
-  return log.length() ? "{" + log + ",\"timeAdjustment\":" + String(cron.lastRun("httpSensorsLog")) + "}" : "{}";
+  device *sensor = this->find(name);
+  String log = this->log(sensor);
+  return log.length() ? "{" + log + ",\"timeAdjustment\":" + String(cron.lastRun(this->logId(sensor->logInterval))) + "}" : "{}";
 }
 
 /*  */
@@ -287,7 +488,7 @@ json sensors::log() {
   if (this->sensorsList) {
     device *sensor = this->sensorsList;
     while (sensor) {
-      log = this->log(sensor);
+      if (sensor->logInterval == (uint32_t)cron::time_10m) log = this->log(sensor);
       if (log.length()) answer += "," + log;
       log = "";
       sensor = sensor->next;
@@ -296,16 +497,158 @@ json sensors::log() {
   } return "{" + answer + "}";
 }
 
+/*  */
+void sensors::logRead(device *sensor, uint16_t last, std::function<void(float)> fn) {
+  if (!sensor or !sensor->log) return;
+  /* Недостающие в начале журнала точки (после старта) выдаются нулями, как и раньше */
+  for (uint16_t i = sensor->log->size(); i < last; i++) fn(0);
+  sensor->log->read(last, fn);
+}
+
+/*  */
+void sensors::log(const char *name, uint16_t last, uint16_t points, std::function<void(const String &)> out) {
+  if (!last) last = this->logSize;
+  uint16_t depth = this->logSize;
+  this->each([&](device *sensor) {
+    if (sensor->log and sensor->log->size() > depth) depth = sensor->log->size();
+  });
+  if (last > depth) last = depth;
+  /* Количество интервалов огибающей, каждый дает две точки: не больше points значений */
+  uint16_t buckets = (points and points < last) ? max(points / 2, 1) : last;
+  bool envelope = buckets < last;
+  float span = envelope ? (float)last / buckets : 1.0;
+  /* Шаг журнала в заголовке - сенсора name или основной (10 минут) */
+  device *named = name ? this->find(name) : 0;
+  uint32_t interval = named ? named->logInterval : (uint32_t)cron::time_10m;
+  String intervals;
+  String chunk = "{\"timeAdjustment\":" + String(cron.lastRun(this->logId(interval))) + ",\"interval\":" + String(interval);
+  chunk += ",\"bucket\":" + String(span);
+  chunk += ",\"bucketInterval\":" + String((uint32_t)(interval * span));
+
+  this->each([&](device *sensor) {
+    if (!sensor->log or (name and strcmp(name, sensor->name))) return;
+    chunk += ",\"" + String(sensor->name) + "\":[";
+    bool first = true;
+    uint16_t index = 0, bucket = 0;
+    float min = 0, max = 0;
+    uint16_t minIndex = 0, maxIndex = 0;
+    auto put = [&](float value) {
+      chunk += (first ? "" : ",") + this->clear(value);
+      first = false;
+      if (chunk.length() >= 512) {
+        out(chunk);
+        chunk = "";
+      }
+    };
+    this->logRead(sensor, last, [&](float value) {
+      if (!envelope) put(value);
+      else {
+        /* Границы интервалов распределяются равномерно: [bucket*last/buckets, (bucket+1)*last/buckets) */
+        if (index == (uint32_t)bucket * last / buckets) {
+          min = max = value;
+          minIndex = maxIndex = index;
+        } else {
+          if (value < min) { min = value; minIndex = index; }
+          if (value > max) { max = value; maxIndex = index; }
+        }
+        if (index + 1 == (uint32_t)(bucket + 1) * last / buckets) {
+          /* Экстремумы в порядке их появления, чтобы сохранить форму графика */
+          put(minIndex <= maxIndex ? min : max);
+          put(minIndex <= maxIndex ? max : min);
+          bucket++;
+        }
+      }
+      index++;
+    });
+    chunk += "]";
+    /* Сенсоры с нестандартным интервалом: [интервал, timeAdjustment] */
+    if (sensor->logInterval != interval) {
+      intervals += String(intervals.length() ? "," : "") + "\"" + sensor->name + "\":[" + String(sensor->logInterval) + "," + String(cron.lastRun(this->logId(sensor->logInterval))) + "]";
+    }
+    yield();
+  });
+  if (intervals.length()) chunk += ",\"intervals\":{" + intervals + "}";
+  out(chunk + "}");
+}
+
 /*  */
 void sensors::logUpdate(device *sensor) {
   if (sensor) {
     if (sensor->log) {
-      sensor->log[sensor->logPosition++] = sensor->lastDimension;
-      if (sensor->logPosition >= this->logSize) sensor->logPosition = 0;
+      sensor->log->push(sensor->lastDimension);
+      this->generation++;
     }
   }
 }
 
+/*  */
+void sensors::logUpdate(uint32_t interval) {
+  this->each([&](device *sensor) {
+    if (sensor->logInterval == interval) this->logUpdate(sensor);
+  });
+}
+
+/*  */
+bool sensors::logConfig(const char *name, uint32_t interval, uint16_t depth) {
+  device *sensor = this->find(name);
+  if (!sensor or this->planned or !interval) return false;
+  sensor->logInterval = interval;
+  sensor->logDepth = depth;
+  return true;
+}
+
+/*  */
+const char *sensors::logId(uint32_t interval) {
+  for (logGroup_t *group = this->logGroups; group; group = group->next) {
+    if (group->interval == interval) return group->id;
+  } return 0;
+}
+
+/*  */
+void sensors::logPlan() {
+  if (this->planned) return;
+  this->planned = true;
+
+  uint32_t requested = 0;
+  this->each([&](device *sensor) {
+    requested += logStore::blocksFor(sensor->logDepth, sensor->knob->step) * sizeof(logStore::block_t);
+  });
+  uint32_t heap = ESP.getFreeHeap();
+  uint32_t budget = heap > this->logReserve ? heap - this->logReserve : 0;
+  float scale = requested > budget ? (float)budget / requested : 1;
+  #ifdef console
+    console.printf("sensors: logs %u bytes requested, %u free, scale %.2f\n", requested, heap, scale);
+  #endif
+
+  this->each([&](device *sensor) {
+    if (!sensor->logDepth) return;
+    uint16_t blocks = logStore::blocksFor(sensor->logDepth, sensor->knob->step) * scale;
+    this->logAttach(sensor, blocks < 2 ? 2 : blocks);
+  });
+}
+
+/*  */
+void sensors::logAttach(device *sensor, uint16_t blocks) {
+  sensor->log = new logStore(sensor->knob->step, blocks);
+  this->structure++;
+  if (!this->logId(sensor->logInterval)) {
+    uint32_t interval = sensor->logInterval;
+    const char *id = interval == cron::time_10m ? "httpSensorsLog" : strdup(("sensorsLog" + String(interval)).c_str());
+    this->logGroups = new logGroup_t{interval, id, this->logGroups};
+    cron.add(interval, [this, interval]() { this->logUpdate(interval); }, id, cron::high);
+    /* Точки журнала на границах интервала по часам - одинаковые отметки времени на всех станциях */
+    cron.schedule(id, cron::aligned);
+  }
+  #ifdef console
+    console.printf("sensors: log %s every %us, %u blocks\n", sensor->name, sensor->logInterval / 1000, sensor->log->capacity());
+  #endif
+}
+
+/*  */
+void sensors::onUpdate(std::function<void(void)> fn) {
+  this->updateHooks = new hook_t{fn, this->updateHooks};
+}
+
 /*  */
 void sensors::logUpdate(const char *name) {
   this->logUpdate(this->find(name));
@@ -326,13 +669,20 @@ void sensors::logUpdate() {
 void sensors::dataUpdate(device *sensor) {
   if (sensor) {
     float data = 0;
-    if (sensor->status or sensor->address == 0x00) {
+    float previous = sensor->lastDimension;
+    if (sensor->readable()) {
+      uint32_t start = micros();
+      supervisor.enter(supervisor::sensor, sensor->name, sensor->address);
       data = sensor->data();
+      supervisor.leave();
+      if (sensor->address != 0x00) i2c.account(sensor->address, !isnan(data), micros() - start);
       if (isnan(data)) {
         if(sensor->status) sensor->status = false;
         data = 0;
       }
     } sensor->lastDimension = data;
+    sensor->changed = (float)sensor->lastDimension != previous;
+    sensor->computed = true;
   }
 }
 
@@ -344,11 +694,31 @@ void sensors::dataUpdate(const char *name) {
 /*  */
 void sensors::dataUpdate() {
   if (this->sensorsList) {
-    device *sensor = this->sensorsList;
-    while (sensor) {
+    if (!this->orderSize) this->sort();
+    for (byte i = 0; i < this->orderSize; i++) {
+      device *sensor = this->order[i];
+      /*
+         Расчетный сенсор пропускается, если ни один из его входов не изменился и его фильтр сошелся
+         (выход медианы равен последнему рассчитанному значению), иначе окно фильтра замерло бы со старыми значениями
+      */
+      if (sensor->inputsCount and sensor->computed and (float)sensor->lastDimension == sensor->lastDimension.last()) {
+        bool changed = false;
+        for (byte n = 0; n < sensor->inputsCount and !changed; n++) changed = sensor->sources[n] and sensor->sources[n]->changed;
+        if (!changed) {
+          sensor->changed = false;
+          continue;
+        }
+      }
       this->dataUpdate(sensor);
-      sensor = sensor->next;
     }
+    for (byte i = 0; i < this->orderSize; i++) {
+      if (this->order[i]->changed) {
+        this->generation++;
+        break;
+      }
+    }
+    this->snapshot();
+    for (hook_t *hook = this->updateHooks; hook; hook = hook->next) hook->fn();
   }
 }
 
@@ -356,10 +726,11 @@ void sensors::dataUpdate() {
 void sensors::checkLine(device *sensor) {
   if (sensor) {
     if (sensor->address != 0x00) {
-      Wire.beginTransmission(sensor->address);
+      supervisor.enter(supervisor::sensor, sensor->name, sensor->address);
       bool oldStatus = sensor->status;
-      sensor->status = (Wire.endTransmission() == 0);
+      sensor->status = i2c.probe(sensor->address);
       if (!oldStatus and oldStatus != sensor->status) sensor->init();
+      supervisor.leave();
     }
   }
 }
@@ -371,6 +742,7 @@ void sensors::checkLine(const char *name) {
 
 /*  */
 void sensors::checkLine() {
+  i2c.cycle();
   if (this->sensorsList) {
     device *sensor = this->sensorsList;
     while (sensor) {
@@ -389,7 +761,12 @@ json sensors::list(bool edging = true) {
     while (sensor) {
       knob += "\"name\":\""  + String(sensor->name)        + "\","; // Имя сенсора
       knob += "\"list\":"    + String(sensor->list)        + ",";   // В каком разделе отобразить датчик
-      knob += "\"log\":"     + String(sensor->log != 0)    + ",";   // Отметка ведения лога
+      knob += "\"log\":"     + String(sensor->logDepth != 0) + ",";   // Отметка ведения лога
+      if (sensor->log) {
+        knob += "\"logInterval\":" + String(sensor->logInterval)    + ","; // Интервал журнала в ms
+        knob += "\"logDepth\":"    + String(sensor->logDepth)       + ","; // Запрошенная глубина в точках
+        knob += "\"logBytes\":"    + String(sensor->log->bytes())   + ","; // Выделенная память
+      }
       knob += "\"min\":"     + String(sensor->knob->min)   + ",";   // Минимальное возможное значение
       knob += "\"max\":"     + String(sensor->knob->max)   + ",";   // Максимальное возможное значение
       knob += "\"step\":\""  + String(sensor->knob->step)  + "\","; // Шаг
@@ -404,6 +781,115 @@ json sensors::list(bool edging = true) {
   } return edging ? "[" + answer + "]" : answer;
 }
 
+/*  */
+void sensors::each(std::function<void(device *)> fn) {
+  device *sensor = this->sensorsList;
+  while (sensor) {
+    fn(sensor);
+    sensor = sensor->next;
+  }
+}
+
+/*  */
+uint32_t sensors::layout() {
+  String names;
+  this->each([&](device *sensor) {
+    if (sensor->remote) return;
+    names += String(sensor->name) + (sensor->log ? "+" + String(sensor->log->capacity()) + "/" + String(sensor->logInterval) : "-");
+  });
+  return rtcMemory.crc32(names.c_str(), names.length(), this->logSize);
+}
+
+/*  */
+void sensors::snapshot() {
+  snapshot_t snapshot = {this->layout(), this->history, {0}};
+  byte i = 0;
+  this->each([&](device *sensor) {
+    if (i < sensors::snapshotSize and !sensor->remote) snapshot.value[i++] = sensor->lastDimension;
+  });
+  rtcMemory.write(this->rtc, &snapshot, sizeof(snapshot));
+}
+
+/*  */
+void sensors::save() {
+  /* Журналы: фазы заданий журналов, затем состояние сжатого журнала по каждому сенсору с логом в порядке списка */
+  uint32_t crc = 0;
+  File file = storage.fs().open(this->historyFile, "w");
+  if (file) {
+    for (logGroup_t *group = this->logGroups; group; group = group->next) {
+      uint32_t adjustment = cron.lastRun(group->id);
+      file.write((uint8_t *)&adjustment, sizeof(adjustment));
+      crc = rtcMemory.crc32Append(&adjustment, sizeof(adjustment), crc);
+    }
+    this->each([&](device *sensor) {
+      if (!sensor->log or sensor->remote) return;
+      sensor->log->serialize([&](const void *data, size_t size) {
+        file.write((const uint8_t *)data, size);
+        crc = rtcMemory.crc32Append(data, size, crc);
+      });
+      yield();
+    });
+    file.close();
+  }
+  this->history = crc ? crc : 1;
+  this->snapshot();
+}
+
+/*  */
+bool sensors::restore() {
+  this->logPlan();
+  snapshot_t snapshot;
+  bool status = false;
+  if (rtcMemory.read(this->rtc, &snapshot, sizeof(snapshot)) and snapshot.layout == this->layout()) {
+    /* Фильтры */
+    byte i = 0;
+    this->each([&](device *sensor) {
+      if (i < sensors::snapshotSize and !sensor->remote) sensor->lastDimension.fill(snapshot.value[i++]);
+    });
+    status = true;
+
+    /* Журналы (только если файл записан перед этой перезагрузкой) */
+    File file = storage.fs().open(this->historyFile, "r");
+    if (snapshot.history and file) {
+      size_t phases = 0, size = 0;
+      for (logGroup_t *group = this->logGroups; group; group = group->next) phases += sizeof(uint32_t);
+      this->each([&](device *sensor) { if (sensor->log and !sensor->remote) size += sensor->log->bytes(); });
+      if (file.size() == phases + size) {
+        uint8_t *buffer = new uint8_t[phases + size];
+        file.read(buffer, phases + size);
+        uint32_t crc = rtcMemory.crc32Append(buffer, phases);
+        uint8_t *position = buffer + phases;
+        this->each([&](device *sensor) {
+          if (!sensor->log or sensor->remote) return;
+          crc = rtcMemory.crc32Append(position, sensor->log->bytes(), crc);
+          position += sensor->log->bytes();
+        });
+        if (crc == snapshot.history) {
+          position = buffer + phases;
+          this->each([&](device *sensor) {
+            if (!sensor->log or sensor->remote) return;
+            sensor->log->deserialize(position);
+            position += sensor->log->bytes();
+          });
+          /* Сохраняем фазы журналов, чтобы точки продолжили ложиться в прежнюю сетку */
+          position = buffer;
+          for (logGroup_t *group = this->logGroups; group; group = group->next, position += sizeof(uint32_t)) {
+            uint32_t adjustment;
+            memcpy(&adjustment, position, sizeof(adjustment));
+            cronEvent *event = cron.find(group->id);
+            if (event) event->time = millis() - adjustment;
+          }
+        }
+        delete [] buffer;
+      }
+    }
+    if (file) file.close();
+  }
+  if (storage.fs().exists(this->historyFile)) storage.fs().remove(this->historyFile);
+  this->history = 0;
+  return status;
+}
+
 /*  */
 String sensors::clear(float value) {
   if ((int)value == 0) return "0";
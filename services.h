@@ -4,6 +4,8 @@
 #include <PubSubClient.h>
 #include <ESP8266HTTPClient.h>
 #include "webserver.h"
+#include "wifi.h"
+#include "sensors.h"
 
 WiFiClient wifiClient;
 PubSubClient mqttAPI(wifiClient);
@@ -54,8 +56,10 @@ void restAPIsend(String host, uint16_t port, String query) {
   HTTPClient restAPI;
   restAPI.setUserAgent("Weather Station " + WiFi.hostname());
   restAPI.setTimeout(3000);
+  supervisor.enter(supervisor::service, host.c_str(), port);
   restAPI.begin(host, port, query);
   int code = restAPI.GET();
+  supervisor.leave();
   #ifdef console
     console.printf("answer: %s\n", httpCodeStr(code).c_str());
   #endif
@@ -64,33 +68,164 @@ void restAPIsend(String host, uint16_t port, String query) {
 }
 
 
-void sendDataToMQTT() {
-  if (wifi.transferDataPossible() and conf.param("mqtt_server").length()) {
+/* Подключение к MQTT брокеру с параметрами из конфигурации */
+bool mqttConnect() {
+  if (mqttAPI.connected()) return true;
+  // баг при прямой передаче значения (c_str) из конфига в setServer (не забыть поправить!)
+  static String server;
+  server = conf.param("mqtt_server");
+  mqttAPI.setServer(server.c_str(), 1883);
+  supervisor.enter(supervisor::service, server.c_str(), 1883);
+  mqttAPI.connect(WiFi.hostname().c_str(),
+    (conf.param("mqtt_login").length() ? conf.param("mqtt_login").c_str() : 0),
+    (conf.param("mqtt_pass").length() ? conf.param("mqtt_pass").c_str() : 0)
+  );
+  supervisor.leave();
+  if (mqttAPI.connected()) return true;
+  #ifdef console
+    console.printf("answer: %s\n", mqttCodeStr(mqttAPI.state()).c_str());
+  #endif
+  return false;
+}
+
+/*
+   Публикация показаний всех сенсоров MQTT брокеру.
+   Вызывается после каждого цикла сбора данных, соединение с брокером постоянное (повторное подключение
+   не чаще раза в минуту). Значение публикуется (retain), только если оно отличается от последнего
+   опубликованного не меньше чем на зону нечувствительности, либо с последней публикации прошло больше
+   silence (по умолчанию 10 минут), поэтому трафик определяется изменениями, а не таймером.
+   Зона нечувствительности по умолчанию - шаг индикатора (knob_t::step), задается после регистрации сенсоров:
+    mqtt.deadband("out_pressure", 0.5);     // абсолютная, в единицах сенсора
+    mqtt.deadband("out_light", 5, true);    // относительная, в процентах
+   Топик - имя сенсора без префикса out_ (out_temperature -> temperature) с префиксом mqtt_path.
+   При mqtt_packed = 1 все значения публикуются одним JSON объектом в топик sensors, если изменилось хотя бы одно.
+*/
+class mqtt {
+  public:
+    /*
+       Запуск в соответствии с конфигурацией, вызывается в setup() после регистрации сенсоров
+    */
+    void begin();
+    /*
+       Зона нечувствительности сенсора (relative - в процентах от последнего опубликованного значения,
+       но не меньше шага индикатора, иначе около нуля значение публиковалось бы каждый цикл)
+    */
+    void deadband(const char *name, float band, bool relative = false);
+    /*
+       Максимальный интервал между публикациями неизменного значения
+    */
+    void silence(uint32_t interval) { this->maxSilence = interval; }
+
+  private:
+    struct entry_t {
+      device *sensor;
+      float band;
+      float step;        // Шаг индикатора - нижняя граница относительной зоны
+      bool relative;
+      bool published = false;
+      float value = 0;   // Последнее опубликованное значение
+      uint32_t time = 0; // Время последней публикации
+      entry_t *next;
+    };
+    void publish();
+    bool due(entry_t *entry, float value, uint32_t now);
+    entry_t *entry(device *sensor);
+    static String topic(const char *name) { return strncmp(name, "out_", 4) ? String(name) : String(name + 4); }
+    static String format(device *sensor, float value);
+
+    entry_t *list = 0;
+    uint32_t maxSilence = cron::time_10m;
+    uint32_t attempt = 0;
+    bool packed = false;
+} mqtt;
+
+/*  */
+void mqtt::begin() {
+  if (!conf.param("mqtt_server").length()) return;
+  this->packed = conf.param("mqtt_packed") == "1";
+  /* Объект со всеми показаниями не помещается в буфер PubSubClient по умолчанию (256 байт) */
+  if (this->packed) mqttAPI.setBufferSize(1024);
+  sensors.onUpdate([this](){ this->publish(); });
+}
+
+/*  */
+void mqtt::deadband(const char *name, float band, bool relative) {
+  device *sensor = sensors.find(name);
+  if (!sensor) return;
+  entry_t *entry = this->entry(sensor);
+  entry->band = band;
+  entry->relative = relative;
+}
+
+/*  */
+mqtt::entry_t *mqtt::entry(device *sensor) {
+  entry_t *entry = this->list;
+  while (entry and entry->sensor != sensor) entry = entry->next;
+  if (!entry) {
+    entry = new entry_t;
+    entry->sensor = sensor;
+    entry->step = sensor->knob->step ? atof(sensor->knob->step) : 0;
+    entry->band = entry->step;
+    entry->relative = false;
+    entry->next = this->list;
+    this->list = entry;
+  } return entry;
+}
+
+/*  */
+bool mqtt::due(entry_t *entry, float value, uint32_t now) {
+  if (!entry->published or now - entry->time >= this->maxSilence) return true;
+  float band = entry->relative ? max(fabsf(entry->value) * entry->band / 100, entry->step) : entry->band;
+  float difference = fabsf(value - entry->value);
+  /* Допуск на погрешность представления шага во float, неизменное значение не публикуется при нулевой зоне */
+  return difference > 0 and difference >= band * 0.999f;
+}
+
+/* Количество знаков после запятой - как у шага индикатора */
+String mqtt::format(device *sensor, float value) {
+  const char *point = sensor->knob->step ? strchr(sensor->knob->step, '.') : 0;
+  return String(value, point ? strlen(point + 1) : 0);
+}
+
+/*  */
+void mqtt::publish() {
+  if (!wifi.transferDataPossible()) return;
+  if (!mqttAPI.connected()) {
+    if (this->attempt and millis() - this->attempt < cron::time_1m) return;
+    this->attempt = millis();
     #ifdef console
-      console.println(F("services: send data to MQTT server"));
+      console.println(F("services: connect to MQTT server"));
     #endif
-    // баг при прямой передаче значения (c_str) из конфига в setServer (не забыть поправить!)
-    String server = conf.param("mqtt_server");
-    mqttAPI.setServer(server.c_str(), 1883);
-    mqttAPI.connect(WiFi.hostname().c_str(),
-      (conf.param("mqtt_login").length() ? conf.param("mqtt_login").c_str() : 0),
-      (conf.param("mqtt_pass").length() ? conf.param("mqtt_pass").c_str() : 0)
-    );
-    if (mqttAPI.connected()) {
-      mqttPublish("light",       sensors.get("out_light"));
-      mqttPublish("temperature", sensors.get("out_temperature"));
-      mqttPublish("humidity",    sensors.get("out_humidity"));
-      mqttPublish("pressure",    sensors.get("out_pressure"));
-      //mqttPublish("co2",         sensors.get("out_co2"));
-      #ifdef console
-        console.println(F("answer: OK"));
-      #endif
-      mqttAPI.disconnect();
-    } else {
-      #ifdef console
-        console.printf("answer: %s\n", mqttCodeStr(mqttAPI.state()).c_str());
-      #endif
+    if (!mqttConnect()) return;
+  }
+  mqttAPI.loop();
+
+  uint32_t now = millis();
+  bool changed = false;
+  String answer;
+  sensors.each([&](device *sensor) {
+    float value = sensor->lastDimension;
+    if (isnan(value) or !sensor->readable()) return;
+    entry_t *entry = this->entry(sensor);
+    bool due = this->due(entry, value, now);
+    if (this->packed) {
+      changed = changed or due;
+      answer += String(answer.length() ? "," : "") + "\"" + mqtt::topic(sensor->name) + "\":" + mqtt::format(sensor, value);
+    } else if (due and mqttPublish(mqtt::topic(sensor->name), mqtt::format(sensor, value))) {
+      entry->published = true;
+      entry->value = value;
+      entry->time = now;
     }
+  });
+  if (this->packed and changed and mqttPublish("sensors", "{" + answer + "}")) {
+    sensors.each([&](device *sensor) {
+      float value = sensor->lastDimension;
+      if (isnan(value) or !sensor->readable()) return;
+      entry_t *entry = this->entry(sensor);
+      entry->published = true;
+      entry->value = value;
+      entry->time = now;
+    });
   }
 }
 
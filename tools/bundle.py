@@ -0,0 +1,82 @@
+#!/usr/bin/env python3
+"""
+Упаковка web интерфейса (каталог data/) в один файл bundle.bin для SPIFFS.
+
+    python3 tools/bundle.py [каталог] [файл]      # по умолчанию data bundle.bin
+
+Формат (little-endian), читается bundle.h:
+    'WSB1', uint16 количество файлов, uint16 размер таблицы строк
+    записи по 20 байт, отсортированные по хэшу пути:
+        uint32 FNV-1a пути запроса ("/index.htm", без .gz)
+        uint32 смещение данных от начала файла
+        uint32 длина
+        uint32 ETag (CRC32 содержимого)
+        uint16 смещение типа содержимого в таблице строк
+        uint16 флаги (1 - данные сжаты gzip)
+    таблица строк: типы содержимого, завершенные нулем
+    данные файлов
+Загружается одним файлом, поэтому прерванная загрузка не оставляет интерфейс обновленным наполовину:
+bundle.h проверяет заголовок и размер и при ошибке возвращается к отдельным файлам SPIFFS.
+"""
+import os
+import struct
+import sys
+import zlib
+
+TYPES = {
+    '.html': 'text/html', '.htm': 'text/html', '.css': 'text/css', '.json': 'application/json',
+    '.js': 'application/javascript', '.png': 'image/png', '.gif': 'image/gif', '.jpg': 'image/jpeg',
+    '.ico': 'image/x-icon', '.svg': 'image/svg+xml', '.eot': 'font/eot', '.woff': 'font/woff',
+    '.woff2': 'font/woff2', '.ttf': 'font/ttf', '.xml': 'text/xml', '.pdf': 'application/pdf',
+    '.zip': 'application/zip',
+}
+
+
+def fnv1a(text):
+    h = 0x811C9DC5
+    for b in text.encode():
+        h = ((h ^ b) * 0x01000193) & 0xFFFFFFFF
+    return h
+
+
+def main():
+    source = sys.argv[1] if len(sys.argv) > 1 else 'data'
+    target = sys.argv[2] if len(sys.argv) > 2 else 'bundle.bin'
+
+    files = []
+    for name in sorted(os.listdir(source)):
+        full = os.path.join(source, name)
+        if not os.path.isfile(full) or name in ('config.json', os.path.basename(target)):
+            continue
+        gzipped = name.endswith('.gz')
+        path = '/' + (name[:-3] if gzipped else name)
+        with open(full, 'rb') as f:
+            data = f.read()
+        files.append((fnv1a(path), path, TYPES.get(os.path.splitext(path)[1], 'text/plain'), gzipped, data))
+
+    files.sort(key=lambda item: item[0])
+    hashes = [item[0] for item in files]
+    if len(set(hashes)) != len(hashes):
+        sys.exit('bundle: hash collision, rename a file')
+
+    strings = b''
+    offsets = {}
+    for item in files:
+        if item[2] not in offsets:
+            offsets[item[2]] = len(strings)
+            strings += item[2].encode() + b'\0'
+
+    offset = 8 + 20 * len(files) + len(strings)
+    index, body = b'', b''
+    for h, path, ctype, gzipped, data in files:
+        index += struct.pack('<IIIIHH', h, offset + len(body), len(data), zlib.crc32(data) & 0xFFFFFFFF, offsets[ctype], 1 if gzipped else 0)
+        body += data
+        print('%-24s %7d %s%s' % (path, len(data), ctype, ', gzip' if gzipped else ''))
+
+    with open(target, 'wb') as f:
+        f.write(b'WSB1' + struct.pack('<HH', len(files), len(strings)) + index + strings + body)
+    print('%s: %d files, %d bytes' % (target, len(files), offset + len(body)))
+
+
+if __name__ == '__main__':
+    main()
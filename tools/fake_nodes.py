@@ -0,0 +1,62 @@
+#!/usr/bin/env python3
+"""
+Имитация станций в режиме member для проверки коллектора (collector.h).
+
+    python3 tools/fake_nodes.py IP [станций] [пакетов в секунду на станцию] [сенсоров] [секунд]
+
+По умолчанию 16 станций, 0.2 пакета в секунду (период сбора 5 с), 8 сенсоров, 60 секунд.
+Датаграмма (little-endian): 'WSC1', uint32 chipId, uint16 номер пакета, uint8 количество,
+затем по каждому сенсору uint8 длина имени, имя, float значение.
+Потери и задержку обработки смотреть в /api/system/collector.
+"""
+import math
+import random
+import socket
+import struct
+import sys
+import time
+
+PORT = 4210
+NAMES = ['out_temperature', 'out_humidity', 'out_pressure', 'in_temperature',
+         'in_humidity', 'out_light', 'out_co2', 'out_dewpoint']
+
+
+def packet(chip, sequence, count, t):
+    names = [NAMES[i % len(NAMES)] + ('' if i < len(NAMES) else str(i // len(NAMES))) for i in range(count)]
+    data = b'WSC1' + struct.pack('<IHB', chip, sequence & 0xFFFF, count)
+    for i, name in enumerate(names):
+        value = 20 + 5 * math.sin(t / 600 + chip + i) + random.uniform(-0.1, 0.1)
+        data += struct.pack('<B', len(name)) + name.encode() + struct.pack('<f', value)
+    return data
+
+
+def main():
+    if len(sys.argv) < 2:
+        print(__doc__)
+        sys.exit(1)
+    host = sys.argv[1]
+    nodes = int(sys.argv[2]) if len(sys.argv) > 2 else 16
+    rate = float(sys.argv[3]) if len(sys.argv) > 3 else 0.2
+    count = int(sys.argv[4]) if len(sys.argv) > 4 else 8
+    duration = float(sys.argv[5]) if len(sys.argv) > 5 else 60
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    chips = [0x100000 + i for i in range(nodes)]
+    sequence = [0] * nodes
+    interval = 1 / (rate * nodes)
+    start = time.time()
+    sent = 0
+    while time.time() - start < duration:
+        i = sent % nodes
+        sequence[i] += 1
+        sock.sendto(packet(chips[i], sequence[i], count, time.time()), (host, PORT))
+        sent += 1
+        delay = start + sent * interval - time.time()
+        if delay > 0:
+            time.sleep(delay)
+    elapsed = time.time() - start
+    print('%d datagrams in %.1f s (%.1f/s), %d nodes x %d sensors' % (sent, elapsed, sent / elapsed, nodes, count))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,47 @@
+#!/usr/bin/env python3
+"""
+Сравнение задержек файловых систем (storage.h) на устройствах: SPIFFS и LittleFS.
+
+    python3 tools/fs_bench.py IP [IP ...] [--files N] [--size N] [--rounds N] [--login admin] [--password admin]
+
+Каждое устройство (или одно и то же после прошивки с другим littleFS в v2.ino) выполняет
+/api/system/fs/bench rounds раз: создание, exists, open, чтение и удаление files временных файлов по size байт.
+Печатается медиана по раундам в микросекундах на операцию, обход каталога - на весь каталог.
+"""
+import argparse
+import json
+import statistics
+import urllib.parse
+import urllib.request
+
+FIELDS = ['create', 'exists', 'missing', 'open', 'read', 'remove', 'dir']
+
+
+def bench(host, files, size, login, password):
+    data = urllib.parse.urlencode({'files': files, 'size': size, 'login': login, 'password': password}).encode()
+    request = urllib.request.Request('http://%s/api/system/fs/bench' % host, data=data,
+                                     headers={'User-Agent': 'fs_bench'})
+    with urllib.request.urlopen(request, timeout=120) as answer:
+        return json.loads(answer.read())
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('hosts', nargs='+')
+    parser.add_argument('--files', type=int, default=32)
+    parser.add_argument('--size', type=int, default=1024)
+    parser.add_argument('--rounds', type=int, default=5)
+    parser.add_argument('--login', default='admin')
+    parser.add_argument('--password', default='admin')
+    args = parser.parse_args()
+
+    print('%-16s %-9s %6s' % ('host', 'fs', 'files') + ''.join('%9s' % field for field in FIELDS))
+    for host in args.hosts:
+        rounds = [bench(host, args.files, args.size, args.login, args.password) for _ in range(args.rounds)]
+        median = {field: statistics.median(r[field] for r in rounds) for field in FIELDS}
+        print('%-16s %-9s %6d' % (host, rounds[0]['fs'], rounds[0]['dirEntries'])
+              + ''.join('%9d' % median[field] for field in FIELDS))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,78 @@
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+/*
+   Минимальная замена окружения Arduino/ESP8266 для сборки заголовков проекта на компьютере (тесты в tools/host).
+   Время управляется тестом через hostMillis, RTC память - массив в памяти процесса.
+*/
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <cstdio>
+#include <cstdarg>
+#include <cmath>
+#include <functional>
+#include <algorithm>
+#include <string>
+using std::isnan;
+
+/* Строка Arduino: достаточно c_str(), length() и сложения */
+class String: public std::string {
+  public:
+    String(const char *text = ""): std::string(text) {}
+    String(const std::string &text): std::string(text) {}
+};
+
+typedef uint8_t byte;
+enum { LOW = 0, HIGH = 1, INPUT = 0, OUTPUT = 1 };
+#define ADC_MODE(mode)
+#define F(text) (text)
+
+uint32_t hostMillis = 0;
+inline uint32_t millis() { return hostMillis; }
+inline uint32_t micros() { return hostMillis * 1000; }
+inline void yield() {}
+inline void delay(uint32_t ms) { hostMillis += ms; }
+inline void pinMode(uint8_t, uint8_t) {}
+inline void digitalWrite(uint8_t, uint8_t) {}
+
+typedef void ETSTimerFunc(void *);
+struct ETSTimer {};
+inline void os_timer_setfn(ETSTimer *, ETSTimerFunc *, void *) {}
+inline void os_timer_arm(ETSTimer *, uint32_t, bool) {}
+inline void os_timer_disarm(ETSTimer *) {}
+
+class hostSerial {
+  public:
+    void begin(uint32_t) {}
+    void println(const char *text = "") { if (this->echo) std::printf("%s\n", text); }
+    void println(int value) { if (this->echo) std::printf("%d\n", value); }
+    void println(double value) { if (this->echo) std::printf("%.2f\n", value); }
+    void printf(const char *format, ...) {
+      if (!this->echo) return;
+      va_list args;
+      va_start(args, format);
+      std::vprintf(format, args);
+      va_end(args);
+    }
+    bool echo = false;
+} Serial;
+
+class hostESP {
+  public:
+    bool rtcUserMemoryRead(uint32_t offset, uint32_t *data, size_t size) {
+      if (offset * 4 + size > sizeof(this->rtc)) return false;
+      memcpy(data, this->rtc + offset * 4, size);
+      return true;
+    }
+    bool rtcUserMemoryWrite(uint32_t offset, uint32_t *data, size_t size) {
+      if (offset * 4 + size > sizeof(this->rtc)) return false;
+      memcpy(this->rtc + offset * 4, data, size);
+      return true;
+    }
+    uint16_t getVcc() { return 3300; }
+    uint32_t getFreeHeap() { return 40000; }
+    uint8_t rtc[512] = {0};
+} ESP;
+
+#endif
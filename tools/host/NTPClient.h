@@ -0,0 +1,15 @@
+#ifndef HOST_NTPCLIENT_H
+#define HOST_NTPCLIENT_H
+
+/* Замена NTP клиента для сборки на компьютере: время задается тестом */
+class WiFiUDP;
+class NTPClient {
+  public:
+    NTPClient(WiFiUDP &, const char *, long = 0, unsigned long = 60000) {}
+    void begin() {}
+    bool forceUpdate() { return this->epoch != 0; }
+    unsigned long getEpochTime() { return this->epoch; }
+    unsigned long epoch = 0;
+};
+
+#endif
@@ -0,0 +1,7 @@
+#ifndef HOST_WIFIUDP_H
+#define HOST_WIFIUDP_H
+
+/* Замена UDP сокета для сборки на компьютере */
+class WiFiUDP {};
+
+#endif
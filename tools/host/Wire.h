@@ -0,0 +1,65 @@
+#ifndef HOST_WIRE_H
+#define HOST_WIRE_H
+
+#include "Arduino.h"
+
+/*
+   Поддельная шина i2c для тестов на компьютере. Устройства подключаются к адресу через Wire.attach(),
+   транзакция записи передается устройству целиком в endTransmission(), чтение - requestFrom().
+   Шина считает транзакции, чтобы тест мог проверить, например, что время читается одним пакетом.
+*/
+class fakeI2CDevice {
+  public:
+    virtual ~fakeI2CDevice() {}
+    /* Запись: первый байт обычно указатель регистра */
+    virtual void write(const uint8_t *data, size_t size) = 0;
+    /* Чтение size байт с текущего указателя, возвращает количество прочитанных */
+    virtual size_t read(uint8_t *data, size_t size) = 0;
+};
+
+class TwoWire {
+  public:
+    void begin(int = -1, int = -1) {}
+    void setClock(uint32_t) {}
+    void attach(uint8_t address, fakeI2CDevice *device) { this->device[address & 0x7F] = device; }
+    void beginTransmission(uint8_t address) {
+      this->address = address & 0x7F;
+      this->txSize = 0;
+    }
+    size_t write(uint8_t value) {
+      if (this->txSize >= sizeof(this->tx)) return 0;
+      this->tx[this->txSize++] = value;
+      return 1;
+    }
+    uint8_t endTransmission(bool = true) {
+      fakeI2CDevice *device = this->device[this->address];
+      if (!device) return 2;  // NACK адреса
+      if (this->txSize) device->write(this->tx, this->txSize);
+      this->writes++;
+      return 0;
+    }
+    uint8_t requestFrom(uint8_t address, size_t size, bool = true) {
+      fakeI2CDevice *device = this->device[address & 0x7F];
+      this->rxSize = this->rxPosition = 0;
+      if (!device) return 0;
+      if (size > sizeof(this->rx)) size = sizeof(this->rx);
+      this->rxSize = device->read(this->rx, size);
+      this->reads++;
+      this->lastRead = this->rxSize;
+      return this->rxSize;
+    }
+    int available() { return this->rxSize - this->rxPosition; }
+    int read() { return this->rxPosition < this->rxSize ? this->rx[this->rxPosition++] : -1; }
+
+    /* Счетчики транзакций и размер последнего чтения */
+    uint32_t writes = 0, reads = 0;
+    size_t lastRead = 0;
+
+  private:
+    fakeI2CDevice *device[128] = {0};
+    uint8_t address = 0;
+    uint8_t tx[32], rx[32];
+    size_t txSize = 0, rxSize = 0, rxPosition = 0;
+} Wire;
+
+#endif
@@ -0,0 +1,164 @@
+/*
+   Тест планировщика (cron.h) на модельном времени millis(): разнесение по фазе заданий с одинаковым интервалом,
+   fixedDelay против fixedRate, режим aligned при подводе часов NTP в течение суток (без повторов и пропусков
+   границ), lastRun() через переполнение millis(), политики skip/burst и бюджет итерации.
+*/
+#include "Arduino.h"
+#include <cstdlib>
+
+/* Сторож заменен заглушкой */
+#define SUPERVISOR_H
+class supervisor {
+  public:
+    enum { cron };
+    void enter(int, const char *, unsigned long) {}
+    void leave() {}
+} supervisor;
+
+#include "../../cron.h"
+
+static int failed = 0;
+#define CHECK(condition) do { if (!(condition)) { std::printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #condition); failed++; } } while (0)
+
+int main() {
+  /* Фаза: пять заданий по 5 с и одно с холодным стартом расходятся на 5000 / 8 = 625 ms */
+  {
+    class cron scheduler;
+    hostMillis = 100000;
+    uint32_t first[6] = {0};
+    int runs[6] = {0}, together = 0;
+    for (int i = 0; i < 6; i++) {
+      scheduler.add(cron::time_5s, [&, i]() {
+        if (!runs[i]) first[i] = millis();
+        runs[i]++;
+        together++;
+      }, i == 5, (const char *)0, i == 4 ? cron::high : cron::normal);
+    }
+    CHECK(runs[5] == 1);                           // Холодный старт - сразу при добавлении
+    runs[5] = 0;
+    int most = 0;
+    for (hostMillis = 100001; hostMillis < 160000; hostMillis++) {
+      together = 0;
+      scheduler.handleEvents();
+      most = std::max(most, together);
+    }
+    for (int i = 0; i < 6; i++) CHECK(first[i] == 100000U + cron::time_5s + i * 625 + 1);
+    for (int i = 0; i < 6; i++) CHECK(runs[i] >= 11 and runs[i] <= 12);
+    CHECK(most == 1);                              // В одной итерации не больше одного задания
+    CHECK(scheduler.deferred == 0);
+  }
+
+  /* fixedDelay накапливает время выполнения (700 ms на запуск), fixedRate - нет: 10 часов по минуте */
+  {
+    class cron scheduler;
+    const char *delay = "delay", *rate = "rate";
+    int delayRuns = 0, rateRuns = 0;
+    hostMillis = 100000;
+    scheduler.add(cron::time_1m, [&]() { delayRuns++; hostMillis += 700; }, delay);
+    scheduler.add(cron::time_1m, [&]() { rateRuns++; hostMillis += 700; }, rate);
+    scheduler.schedule(rate, cron::fixedRate);
+    while (hostMillis < 100000 + cron::time_10h) {
+      scheduler.handleEvents();
+      hostMillis++;
+    }
+    std::printf("cron: 10 h of 1 min jobs taking 700 ms: fixedDelay %d runs, fixedRate %d runs\n", delayRuns, rateRuns);
+    CHECK(rateRuns >= 599 and rateRuns <= 600);
+    CHECK(delayRuns <= 594);
+  }
+
+  /*
+     aligned: сутки с подводом часов NTP каждые 7 минут. Как в NTPClient, epoch - целые секунды на момент ответа,
+     дробная часть теряется (часы отстают до секунды); кварц модуля уходит на 50 ppm
+  */
+  {
+    class cron scheduler;
+    const char *id = "aligned";
+    uint32_t epoch = 0, base = 0;
+    scheduler.clock([&]() { return epoch ? epoch + (millis() - base) / 1000 : 0; });
+    uint32_t last = 0;
+    int runs = 0, duplicate = 0, missed = 0, off = 0;
+    scheduler.add(cron::time_10m, [&]() {
+      uint32_t wall = epoch + (millis() - base) / 1000;
+      uint32_t boundary = (wall + 300) / 600;
+      if (boundary == last) duplicate++;
+      else if (last and boundary != last + 1) missed++;
+      if (wall % 600 > 1 and wall % 600 < 599) off++;
+      last = boundary;
+      runs++;
+    }, id);
+    scheduler.schedule(id, cron::aligned);
+    for (hostMillis = 100000; hostMillis < 100000 + cron::time_1d; hostMillis++) {
+      if (hostMillis == 200000 or (epoch and hostMillis % 420000 == 0)) {
+        epoch = (1700000123456ULL + (uint64_t)((hostMillis - 200000) * 1.00005)) / 1000;
+        base = hostMillis;
+      }
+      scheduler.handleEvents();
+    }
+    std::printf("cron: aligned 24 h with NTP: %d runs, %d duplicate, %d missed, %d off boundary\n", runs, duplicate, missed, off);
+    CHECK(runs == 144 and duplicate == 0 and missed == 0 and off == 0);
+  }
+
+  /* lastRun() по модулю 2^32: переполнение millis() и запуск, назначенный на будущее */
+  {
+    class cron scheduler;
+    const char *id = "wrap";
+    int runs = 0;
+    hostMillis = 0xFFFFFFFF - 2000;
+    scheduler.add(cron::time_5s, [&]() { runs++; }, id);
+    hostMillis += 3000;                            // millis() переполнился
+    CHECK(scheduler.lastRun(id) == 3000);
+    for (int i = 0; i <= 2001; i++, hostMillis++) scheduler.handleEvents();
+    CHECK(runs == 1);
+    CHECK(scheduler.lastRun(id) == 1);             // Запуск на последней итерации, затем шаг 1 ms
+    scheduler.find(id)->time = millis() + 1000;    // Запуск в будущем не считается просроченным
+    CHECK(scheduler.lastRun(id) == 0);
+    scheduler.handleEvents();
+    CHECK(runs == 1);
+  }
+
+  /* fixedRate после простоя 3.5 интервала: skip - один запуск с сохранением фазы, burst - пропущенные подряд */
+  for (uint8_t catchup : {(uint8_t)cron::skip, (uint8_t)cron::burst}) {
+    class cron scheduler;
+    const char *id = "catchup";
+    int runs = 0;
+    hostMillis = 100000;
+    scheduler.add(cron::time_1s, [&]() { runs++; }, id);
+    scheduler.schedule(id, cron::fixedRate, catchup);
+    hostMillis += 3500;
+    for (int i = 0; i < 10; i++) scheduler.handleEvents();
+    CHECK(runs == (catchup == cron::skip ? 1 : 3));
+    /* Фаза сохранена: следующий запуск на отметке 4000 ms от добавления */
+    hostMillis = 100000 + 4000;
+    scheduler.handleEvents();
+    CHECK(runs == (catchup == cron::skip ? 1 : 3));
+    hostMillis++;
+    scheduler.handleEvents();
+    CHECK(runs == (catchup == cron::skip ? 2 : 4));
+  }
+
+  /* Бюджет итерации: обычные задания по 30 ms откладываются после 50 ms, высокий приоритет и сильно просроченные - нет */
+  {
+    class cron scheduler;
+    int runs[5] = {0};
+    hostMillis = 100000;
+    for (int i = 0; i < 4; i++) scheduler.add(cron::time_10s + i, [&, i]() { runs[i]++; hostMillis += 30; });
+    scheduler.add(cron::time_10s + 4, [&]() { runs[4]++; hostMillis += 30; }, (const char *)0, cron::high);
+    hostMillis += cron::time_10s + 10;
+    scheduler.handleEvents();
+    CHECK(runs[4] == 1);                           // Высокий приоритет первым в очереди
+    CHECK(runs[0] + runs[1] + runs[2] + runs[3] == 1);
+    CHECK(scheduler.deferred == 3);
+    scheduler.handleEvents();
+    CHECK(runs[0] + runs[1] + runs[2] + runs[3] == 3);
+    CHECK(scheduler.deferred == 4);
+    scheduler.handleEvents();
+    CHECK(runs[0] == 1 and runs[1] == 1 and runs[2] == 1 and runs[3] == 1);
+    /* Просрочка больше двух интервалов - выполнение вне бюджета */
+    hostMillis += 2 * cron::time_10s + 100;
+    scheduler.handleEvents();
+    CHECK(runs[0] == 2 and runs[1] == 2 and runs[2] == 2 and runs[3] == 2 and runs[4] == 2);
+  }
+
+  std::printf("cron: %s\n", failed ? "FAILED" : "OK");
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,115 @@
+/*
+   Тест драйвера DS3231 (ds3231.h) на поддельной шине i2c: пакетное чтение времени, флаг остановки
+   генератора (OSF), 12-ти часовой формат, запись и обратное чтение каждого дня 2000..2105 (предел uint32) с проверкой
+   регистров относительно gmtime().
+*/
+#include "Arduino.h"
+#include "Wire.h"
+#include <ctime>
+
+/* Планировщик, WiFi и сенсоры, которые использует ds3231.h, заменены заглушками */
+#define CRON_H
+#define WIFI_H2
+class cron {
+  public:
+    enum { time_1m = 60000, time_1h = 3600000, low = 2 };
+    void add(unsigned long, std::function<void(void)>, const char *, uint8_t) {}
+    void update(const char *, unsigned long) {}
+    void clock(std::function<uint32_t(void)>) {}
+} cron;
+struct { bool transferDataPossible() { return true; } } wifi;
+struct { float get(const char *) { return 0; } } sensors;
+float b, c;
+int z;
+#define console Serial
+
+#include "../../ds3231.h"
+
+/* Модель DS3231: 19 регистров, указатель с автоинкрементом */
+class fakeDS3231: public fakeI2CDevice {
+  public:
+    void write(const uint8_t *data, size_t size) override {
+      this->pointer = data[0] % sizeof(this->reg);
+      for (size_t i = 1; i < size; i++) this->reg[this->next()] = data[i];
+    }
+    size_t read(uint8_t *data, size_t size) override {
+      for (size_t i = 0; i < size; i++) data[i] = this->reg[this->next()];
+      return size;
+    }
+    uint8_t reg[0x13] = {0};
+  private:
+    uint8_t next() {
+      uint8_t current = this->pointer;
+      this->pointer = (this->pointer + 1) % sizeof(this->reg);
+      return current;
+    }
+    uint8_t pointer = 0;
+};
+
+static int failed = 0;
+#define CHECK(condition) do { if (!(condition)) { std::printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #condition); failed++; } } while (0)
+
+static uint8_t bcd(int value) { return ((value / 10) << 4) | (value % 10); }
+
+int main() {
+  fakeDS3231 chip;
+  Wire.attach(ds3231::address, &chip);
+
+  /* Пакетное чтение: 29.02.2024 23:59:58 */
+  const uint8_t time[7] = {bcd(58), bcd(59), bcd(23), 4, bcd(29), bcd(2), bcd(24)};
+  memcpy(chip.reg, time, sizeof(time));
+  hostMillis = 1000;
+  ds3231.begin();
+  CHECK(ds3231.now() == 1709251198);
+  CHECK(Wire.reads == 2 and Wire.lastRead == 7);  // Регистр статуса и одно чтение 7 регистров
+  CHECK(strcmp(ds3231.source(), "rtc") == 0);
+  hostMillis += 2500;
+  CHECK(ds3231.now() == 1709251200);               // Ход по millis() между чтениями, переход через полночь
+  CHECK(ds3231.hours() == 0);
+
+  /* 12-ти часовой формат: 11 PM */
+  chip.reg[2] = 0x40 | 0x20 | bcd(11);
+  uint32_t epoch;
+  CHECK(ds3231.read(epoch) and epoch % 86400 / 3600 == 23);
+  chip.reg[2] = 0x40 | bcd(12);                    // 12 AM - полночь
+  CHECK(ds3231.read(epoch) and epoch % 86400 / 3600 == 0);
+
+  /* Флаг остановки генератора: время недостоверно, часы не используются */
+  memcpy(chip.reg, time, sizeof(time));
+  chip.reg[0x0F] = 0x80;
+  class ds3231 lost;
+  lost.begin();
+  CHECK(lost.now() == 0);
+  CHECK(strcmp(lost.source(), "none") == 0);
+  CHECK(!lost.read(epoch));
+
+  /* Запись сбрасывает OSF */
+  CHECK(lost.write(1709251198));
+  CHECK((chip.reg[0x0F] & 0x80) == 0);
+  CHECK(lost.read(epoch) and epoch == 1709251198);
+
+  /* Календарь: каждый день 2000..2105, регистры против gmtime() и обратное чтение */
+  uint32_t days = 0;
+  for (time_t t = 946684800; t < 4291747200LL; t += 86400, days++) {
+    uint32_t value = t + (days * 7919) % 86400;
+    if (!ds3231.write(value)) {
+      CHECK(false);
+      break;
+    }
+    time_t v = value;
+    struct tm tm;
+    gmtime_r(&v, &tm);
+    bool registers = chip.reg[0] == bcd(tm.tm_sec) and chip.reg[1] == bcd(tm.tm_min) and chip.reg[2] == bcd(tm.tm_hour)
+      and chip.reg[3] == (tm.tm_wday + 6) % 7 + 1 and chip.reg[4] == bcd(tm.tm_mday)
+      and (chip.reg[5] & 0x1F) == bcd(tm.tm_mon + 1) and ((chip.reg[5] & 0x80) != 0) == (tm.tm_year >= 200)
+      and chip.reg[6] == bcd(tm.tm_year % 100);
+    uint32_t back = 0;
+    if (!registers or !ds3231.read(back) or back != value) {
+      std::printf("FAIL calendar %u (%04d-%02d-%02d): read %u\n", value, tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, back);
+      failed++;
+      break;
+    }
+  }
+  std::printf("ds3231: %u days checked, %s\n", days, failed ? "FAILED" : "OK");
+  return failed ? 1 : 0;
+}
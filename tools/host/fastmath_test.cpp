@@ -0,0 +1,114 @@
+/*
+   Точность и скорость fastExp/fastLog/fastAtan и психрометрических функций из tools.h
+   относительно libm двойной точности. Перебор на сетке, ошибки печатаются и сравниваются
+   с пределами, указанными в комментариях tools.h. Время на вызов измеряется на компьютере,
+   на ESP8266 (без FPU) выигрыш больше - double там считается программно.
+*/
+#include "Arduino.h"
+#include <chrono>
+#include <random>
+#include "../../tools.h"
+
+static int failed = 0;
+
+/* Максимальная ошибка на сетке и проверка предела */
+static void report(const char *name, double error, double limit) {
+  bool ok = error <= limit;
+  std::printf("%-18s max error %.2e (limit %.1e) %s\n", name, error, limit, ok ? "OK" : "FAIL");
+  if (!ok) failed++;
+}
+
+/* Исходные формулы в double */
+static double absoluteHumidityRef(double t, double h) { return (6.112 * exp((17.67 * t) / (t + 243.5)) * h * 2.1674) / (273.15 + t); }
+static double dewPointRef(double t, double h) {
+  double a = 17.271, b = 237.7, temp = (a * t) / (b + t) + log(h * 0.01);
+  return (b * temp) / (a - temp);
+}
+static double wetBulbRef(double t, double h) {
+  return t * atan(0.151977 * sqrt(h + 8.313659)) + atan(t + h) - atan(h - 1.676331) + 0.00391838 * pow(h, 1.5) * atan(0.023101 * h) - 4.686035;
+}
+
+/* Индекс жары NOAA в double и в °F, как на странице методики */
+static double heatIndexRef(double t, double h) {
+  double f = t * 1.8 + 32;
+  double index = 0.5 * (f + 61.0 + ((f - 68.0) * 1.2) + (h * 0.094));
+  if ((index + f) / 2 >= 80) {
+    index = -42.379 + 2.04901523 * f + 10.14333127 * h - .22475541 * f * h - .00683783 * f * f - .05481717 * h * h
+            + .00122874 * f * f * h + .00085282 * f * h * h - .00000199 * f * f * h * h;
+    if (h < 13 and f >= 80 and f <= 112) index -= ((13 - h) / 4) * sqrt((17 - fabs(f - 95.)) / 17);
+    else if (h > 85 and f >= 80 and f <= 87) index += ((h - 85) / 10) * ((87 - f) / 5);
+  }
+  return (index - 32) / 1.8;
+}
+
+/* Наносекунд на вызов, результат суммируется, чтобы вызов не был удален оптимизатором */
+volatile float sink;
+template <typename F> static double bench(F f) {
+  const int count = 2000000;
+  float sum = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < count; i++) sum += f(0.5f + (i & 1023) * 0.001f);
+  auto end = std::chrono::steady_clock::now();
+  sink = sum;
+  return std::chrono::duration<double, std::nano>(end - start).count() / count;
+}
+
+int main() {
+  double error = 0;
+  for (double x = -20; x <= 20; x += 1e-4) error = std::max(error, fabs(fastExp(x) - exp((float)x)) / exp((float)x));
+  report("fastExp (rel)", error, 5e-6);
+
+  error = 0;
+  for (double x = 0.005; x <= 1.5; x += 1e-6) error = std::max(error, fabs(fastLog(x) - log((float)x)));
+  report("fastLog (abs)", error, 5e-7);
+
+  error = 0;
+  for (double x = -1000; x <= 1000; x += 1e-3) error = std::max(error, fabs(fastAtan(x) - atan((float)x)));
+  for (double x = 1e3; x <= 1e8; x *= 1.001) error = std::max(error, fabs(fastAtan(x) - atan((float)x)));
+  report("fastAtan (abs)", error, 2e-6);
+
+  /* -40..+60 °C и 1..100 %: сетка через 0.01 °C и 0.1 %, затем случайные точки (сетка пропускает максимумы) */
+  double ah = 0, dp = 0, wb = 0;
+  auto check = [&](float t, float h) {
+    ah = std::max(ah, fabs(absoluteHumidity(t, h) - absoluteHumidityRef(t, h)));
+    dp = std::max(dp, fabs(dewPoint(t, h) - dewPointRef(t, h)));
+    wb = std::max(wb, fabs(wetBulb(t, h) - wetBulbRef(t, h)));
+  };
+  for (int i = 0; i <= 10000; i++) {
+    for (int j = 0; j <= 990; j++) check(-40 + i * 0.01f, 1 + j * 0.1f);
+  }
+  std::mt19937 random(1);
+  std::uniform_real_distribution<float> t(-40, 60), h(1, 100);
+  for (int i = 0; i < 20000000; i++) check(t(random), h(random));
+  report("absoluteHumidity", ah, 4e-4);
+  report("dewPoint", dp, 2e-5);
+  report("wetBulb", wb, 1.2e-4);
+
+  /*
+     Индекс жары: 0..+50 °C и 1..100 % относительно double, затем точки таблицы NWS (°F, округлены до градуса).
+     На пороге выбора формулы методика сама разрывна (до 1 °C), там float и double могут выбрать разные ветви
+  */
+  double hi = 0;
+  for (int i = 0; i <= 5000; i++) {
+    for (int j = 0; j <= 990; j++) {
+      float t = i * 0.01f, h = 1 + j * 0.1f;
+      double f = t * 1.8 + 32;
+      if (fabs((0.5 * (f + 61.0 + (f - 68.0) * 1.2 + h * 0.094) + f) / 2 - 80) < 1e-3) continue;
+      hi = std::max(hi, fabs(heatIndex(t, h) - heatIndexRef(t, h)));
+    }
+  }
+  report("heatIndex", hi, 4e-4);
+  static const struct { float f, h, index; } table[] = {
+    {80, 40, 80}, {84, 60, 88}, {86, 90, 105}, {90, 40, 91}, {90, 60, 100}, {90, 80, 113},
+    {96, 65, 121}, {100, 40, 109}, {100, 55, 124}, {104, 40, 119}, {110, 40, 136}
+  };
+  hi = 0;
+  for (const auto &point : table) hi = std::max(hi, fabs(heatIndex((point.f - 32) / 1.8f, point.h) * 1.8 + 32 - point.index));
+  report("heatIndex NWS (F)", hi, 0.5);
+
+  std::printf("host ns/call: exp %.1f/%.1f, log %.1f/%.1f, atan %.1f/%.1f (fast/double)\n",
+    bench([](float x) { return fastExp(x); }), bench([](float x) { return (float)exp((double)x); }),
+    bench([](float x) { return fastLog(x); }), bench([](float x) { return (float)log((double)x); }),
+    bench([](float x) { return fastAtan(x); }), bench([](float x) { return (float)atan((double)x); }));
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,180 @@
+/*
+   Тест потокового gzip (gzip.h): распаковка независимым декодером (RFC 1951/1952, фиксированные коды и stored
+   блоки) с проверкой CRC32 и длины. Журнал сенсоров в формате /api/sensors/log порциями по 512 байт,
+   переход на stored блоки по бюджету времени, пустой поток и длинные повторы (совпадения 258 байт, дистанция 1 КБ).
+*/
+#include "Arduino.h"
+#include <random>
+#include <vector>
+
+#include "../../gzip.h"
+
+static int failed = 0;
+#define CHECK(condition) do { if (!(condition)) { std::printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #condition); failed++; } } while (0)
+
+/* Декодер deflate: только то, что выдает gzip.h (тип 0 и 1), динамические коды считаются ошибкой */
+class inflater {
+  public:
+    inflater(const std::vector<uint8_t> &in): in(in) {}
+    bool run(std::vector<uint8_t> &out) {
+      if (this->in.size() < 18 or this->in[0] != 0x1F or this->in[1] != 0x8B or this->in[2] != 8 or this->in[3]) return false;
+      this->position = 10;
+      bool final = false;
+      while (!final) {
+        if (this->error) return false;
+        final = this->bits(1);
+        uint8_t type = this->bits(2);
+        if (type == 0) {
+          this->count = 0;
+          if (this->position + 4 > this->in.size()) return false;
+          uint16_t length = this->in[this->position] | this->in[this->position + 1] << 8;
+          uint16_t inverse = this->in[this->position + 2] | this->in[this->position + 3] << 8;
+          if ((uint16_t)~length != inverse or this->position + 4 + length > this->in.size()) return false;
+          out.insert(out.end(), this->in.begin() + this->position + 4, this->in.begin() + this->position + 4 + length);
+          this->position += 4 + length;
+        } else if (type == 1) {
+          if (!this->fixed(out)) return false;
+        } else return false;
+      }
+      /* Хвост: CRC32 и длина исходных данных */
+      this->count = 0;
+      if (this->position + 8 != this->in.size()) return false;
+      uint32_t crc = 0xFFFFFFFF;
+      for (uint8_t value : out) {
+        crc ^= value;
+        for (int i = 0; i < 8; i++) crc = (crc >> 1) ^ (crc & 1 ? 0xEDB88320 : 0);
+      }
+      return this->word(this->position) == ~crc and this->word(this->position + 4) == out.size();
+    }
+
+  private:
+    bool fixed(std::vector<uint8_t> &out) {
+      static const uint16_t lengthBase[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+      static const uint8_t  lengthExtra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+      static const uint16_t distanceBase[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+      static const uint8_t  distanceExtra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+      while (!this->error) {
+        uint16_t symbol = this->symbol();
+        if (symbol < 256) out.push_back(symbol);
+        else if (symbol == 256) return true;
+        else if (symbol > 285) return false;
+        else {
+          uint16_t length = lengthBase[symbol - 257] + this->bits(lengthExtra[symbol - 257]);
+          uint16_t code = 0;
+          for (int i = 0; i < 5; i++) code = (code << 1) | this->bits(1);
+          if (code > 29) return false;
+          uint32_t distance = distanceBase[code] + this->bits(distanceExtra[code]);
+          if (distance > out.size()) return false;
+          for (uint16_t i = 0; i < length; i++) out.push_back(out[out.size() - distance]);
+        }
+      } return false;
+    }
+    /* Фиксированный код Хаффмана, старшим битом вперед */
+    uint16_t symbol() {
+      uint16_t code = 0;
+      for (int i = 0; i < 7; i++) code = (code << 1) | this->bits(1);
+      if (code <= 0x17) return 256 + code;
+      code = (code << 1) | this->bits(1);
+      if (code >= 0x30 and code <= 0xBF) return code - 0x30;
+      if (code >= 0xC0 and code <= 0xC7) return 280 + code - 0xC0;
+      code = (code << 1) | this->bits(1);
+      return 144 + code - 0x190;
+    }
+    uint32_t bits(uint8_t size) {
+      uint32_t value = 0;
+      for (uint8_t i = 0; i < size; i++) {
+        if (!this->count) {
+          if (this->position >= this->in.size()) {
+            this->error = true;
+            return 0;
+          }
+          this->current = this->in[this->position++];
+          this->count = 8;
+        }
+        value |= (uint32_t)(this->current & 1) << i;
+        this->current >>= 1;
+        this->count--;
+      }
+      return value;
+    }
+    uint32_t word(size_t at) { return this->in[at] | this->in[at + 1] << 8 | this->in[at + 2] << 16 | (uint32_t)this->in[at + 3] << 24; }
+
+    const std::vector<uint8_t> &in;
+    size_t position = 0;
+    uint8_t current = 0, count = 0;
+    bool error = false;
+};
+
+/* Сжатие порциями chunk байт; каждая выдача сжатых данных "стоит" cost ms модельного времени */
+static std::vector<uint8_t> compress(const std::string &text, size_t chunk, uint32_t budget, uint32_t cost, gzip **done = 0) {
+  std::vector<uint8_t> out;
+  gzip *stream = new gzip([&](const uint8_t *data, size_t size) {
+    out.insert(out.end(), data, data + size);
+    hostMillis += cost;
+  }, budget);
+  for (size_t i = 0; i < text.size(); i += chunk) stream->write(String(text.substr(i, chunk)));
+  stream->finish();
+  CHECK(stream->in == text.size() and stream->total == out.size());
+  if (done) *done = stream;
+  else delete stream;
+  return out;
+}
+
+static bool roundTrip(const std::vector<uint8_t> &packed, const std::string &text) {
+  std::vector<uint8_t> back;
+  inflater decoder(packed);
+  return decoder.run(back) and std::string(back.begin(), back.end()) == text;
+}
+
+int main() {
+  /* Журнал шести сенсоров за неделю (1008 точек), как отдает /api/sensors/log */
+  std::mt19937 random(39);
+  std::normal_distribution<float> gauss(0, 1);
+  std::string log = "{\"timeAdjustment\":123456,\"interval\":600000,\"bucket\":1.00,\"bucketInterval\":600000";
+  const char *names[] = {"temperature", "pressure", "humidity", "dewPoint", "windSpeed", "light"};
+  for (int s = 0; s < 6; s++) {
+    log += std::string(",\"") + names[s] + "\":[";
+    float value = 20 + s * 100;
+    for (int i = 0; i < 1008; i++) {
+      value += 0.3 * gauss(random);
+      char text[16];
+      std::snprintf(text, sizeof(text), "%s%.2f", i ? "," : "", value);
+      log += text;
+    }
+    log += "]";
+  }
+  log += "}";
+
+  gzip *stream;
+  std::vector<uint8_t> packed = compress(log, 512, 40000, 0, &stream);
+  CHECK(roundTrip(packed, log));
+  CHECK(!stream->stored);
+  std::printf("gzip: log %u -> %u bytes (%.0f%%)\n", (unsigned)log.size(), (unsigned)packed.size(), packed.size() * 100.0 / log.size());
+  CHECK(packed.size() * 10 < log.size() * 6);
+  delete stream;
+
+  /* Бюджет: 1 ms на каждые 512 байт выдачи при бюджете 3 ms - начало сжато, остаток в stored блоках */
+  packed = compress(log, 512, 3000, 1, &stream);
+  CHECK(stream->stored);
+  CHECK(roundTrip(packed, log));
+  std::printf("gzip: log over budget -> %u bytes, stored after %u us\n", (unsigned)packed.size(), stream->time);
+  delete stream;
+  /* Переход на stored внутри одной большой порции (больше 64 КБ - несколько stored блоков) */
+  std::string big = log + log + log;
+  packed = compress(big, big.size(), 3000, 1);
+  CHECK(roundTrip(packed, big));
+
+  /* Пустой поток, короткий ответ, длинные повторы и повтор на границе окна */
+  CHECK(roundTrip(compress("", 512, 40000, 0), ""));
+  CHECK(roundTrip(compress("{}", 512, 40000, 0), "{}"));
+  std::string repeat(10000, 'a');
+  packed = compress(repeat, 700, 40000, 0);
+  CHECK(roundTrip(packed, repeat) and packed.size() < 200);
+  std::string pattern;
+  for (int i = 0; i < 1024; i++) pattern += (char)(random() & 0xFF);
+  std::string window = pattern + pattern + pattern;
+  CHECK(roundTrip(compress(window, 333, 40000, 0), window));
+
+  std::printf("gzip: %s\n", failed ? "FAILED" : "OK");
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,96 @@
+/*
+   Тест сжатого журнала (logstore.h): точное восстановление квантованных значений, включая скачки через escape,
+   чтение последних точек, сериализация, и глубина журнала при планировании blocksFor() на суточных рядах
+   с шумом для шагов индикаторов станции (температура 0.1, давление и влажность 0.01).
+*/
+#include "Arduino.h"
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "../../logstore.h"
+
+static int failed = 0;
+#define CHECK(condition) do { if (!(condition)) { std::printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #condition); failed++; } } while (0)
+
+static std::vector<float> readAll(logStore &log, uint16_t last) {
+  std::vector<float> out;
+  log.read(last, [&](float value) { out.push_back(value); });
+  return out;
+}
+
+/* Суточный ход, медленный дрейф погоды (случайное блуждание) и шум датчика, точка каждые 10 минут */
+struct profile_t {
+  const char *name;
+  const char *step;
+  float mean, daily, drift, noise;
+};
+
+int main() {
+  std::mt19937 random(20261019);
+  std::normal_distribution<float> gauss(0, 1);
+
+  /* Восстановление: каждая точка равна квантованному значению, длинные разности и пределы квантования */
+  {
+    logStore log(".1", 8);
+    std::vector<float> pushed;
+    for (int i = 0; i < 300; i++) {
+      float value = 20 + 5 * sin(i / 20.0) + 0.3 * gauss(random);
+      if (i == 50) value = -39.9;                  // Скачок после обрыва датчика
+      if (i == 51) value = 1e12;                   // Ограничение 1e9 шагов
+      if (i == 52) value = -1e12;
+      if (i == 53) value = NAN;                    // NaN хранится как 0
+      log.push(value);
+      float q = value / 0.1f;
+      int32_t step = std::isnan(q) ? 0 : q > 1e9 ? 1000000000 : q < -1e9 ? -1000000000 : lroundf(q);
+      pushed.push_back(step * 0.1f);
+    }
+    CHECK(log.size() == 300);
+    std::vector<float> back = readAll(log, 300);
+    CHECK(back.size() == 300);
+    for (size_t i = 0; i < back.size() and i < pushed.size(); i++) {
+      if (back[i] != pushed[i]) {
+        std::printf("FAIL round trip %u: %g != %g\n", (unsigned)i, back[i], pushed[i]);
+        failed++;
+        break;
+      }
+    }
+    std::vector<float> tail = readAll(log, 10);
+    CHECK(tail.size() == 10 and tail.front() == pushed[290] and tail.back() == pushed[299]);
+
+    /* Сериализация в буфер и восстановление в журнал того же размера */
+    std::vector<uint8_t> buffer;
+    log.serialize([&](const void *data, size_t size) { buffer.insert(buffer.end(), (const uint8_t *)data, (const uint8_t *)data + size); });
+    CHECK(buffer.size() == log.bytes());
+    logStore copy(".1", 8);
+    copy.deserialize(buffer.data());
+    CHECK(copy.size() == 300 and readAll(copy, 300) == back);
+    /* Продолжение записи после восстановления: состояние кодера сохранено вместе с журналом */
+    log.push(21.5);
+    copy.push(21.5);
+    CHECK(readAll(copy, 301) == readAll(log, 301));
+  }
+
+  /* Глубина: четыре недели записи в журнал, спланированный на неделю (1008 точек), минимум за последнюю неделю */
+  const profile_t profiles[] = {
+    {"temperature", ".1",  15,   6,    0.05, 0.05},
+    {"pressure",    ".01", 750,  0.4,  0.03, 0.01},
+    {"humidity",    ".01", 60,   20,   0.15, 0.1},
+  };
+  for (const profile_t &p : profiles) {
+    uint16_t blocks = logStore::blocksFor(1008, p.step);
+    logStore log(p.step, blocks);
+    float drift = 0;
+    uint16_t depth = 0xFFFF;
+    for (int i = 0; i < 4 * 1008; i++) {
+      drift += p.drift * gauss(random);
+      log.push(p.mean + p.daily * sin(i * 2 * M_PI / 144) + drift + p.noise * gauss(random));
+      if (i >= 3 * 1008) depth = std::min(depth, log.size());
+    }
+    std::printf("logstore: %-11s step %-3s %2u blocks (%4u bytes), depth %u points\n", p.name, p.step, blocks, (unsigned)log.bytes(), depth);
+    CHECK(depth >= 1008);
+  }
+
+  std::printf("logstore: %s\n", failed ? "FAILED" : "OK");
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,10 @@
+#!/bin/sh
+# Сборка и запуск тестов драйверов на компьютере: ./tools/host/run.sh
+# Заглушки ядра ESP8266 и поддельная шина i2c лежат рядом (Arduino.h, Wire.h)
+cd "$(dirname "$0")" || exit 1
+status=0
+for test in *_test.cpp; do
+  binary="${TMPDIR:-/tmp}/${test%.cpp}"
+  ${CXX:-g++} -std=c++11 -O2 -Wall -I. "$test" -o "$binary" -lm && "$binary" || status=1
+done
+exit $status
@@ -0,0 +1,8 @@
+#ifndef HOST_UMM_MALLOC_H
+#define HOST_UMM_MALLOC_H
+
+/* Замена статистики кучи ESP8266 для сборки на компьютере */
+struct { size_t freeBlocks = 0, maxFreeContiguousBlocks = 0; } ummHeapInfo;
+inline void umm_info(void *, int) {}
+
+#endif
@@ -111,7 +111,7 @@ knob_t *ZAM = new knob_t( 0,   1,  ".1", "Заморозок",  "ед");
    Функция описывает пример конфигурации датчиков в зависимости от
 */
 void sensors_config() {
-  Wire.begin(4, 5);
+  i2c.begin(4, 5, i2c::fast); // SDA, SCL, частота шины 400 кГц
   BME.begin();
   
 // int a = BME.pres(BME280::PresUnit_torr);
@@ -173,6 +173,7 @@ void sensors_config() {
     sensors.add(DP, device::out, "out_dewPoint", [&](){
       return dewPoint(sensors.get("out_temperature"), sensors.get("out_humidity"));
     });
+    sensors.depends("out_dewPoint", {"out_temperature", "out_humidity"});
   
   /*
   sensors.add(new knob_t(-100, 0, "1", "RSSI", "dbm"), device::in, "rssi",[&](){ 
@@ -52,7 +52,7 @@ float in_pres()  { return BME_IN.pres(BME280::PresUnit_torr); }
 
 /* Добавление датчиков в систему */
 void sensors_config() {
-  Wire.begin(4, 5);
+  i2c.begin(4, 5, i2c::fast); // SDA, SCL, частота шины 400 кГц
   
   /* Внешний датчик */
   sensors.add(P, device::out, 0x76, "out_pressure",    out_pres, true);
@@ -61,6 +61,8 @@ void sensors_config() {
 
   sensors.add(AH, device::out, "out_absoluteHumidity", [&](){ return absoluteHumidity(sensors.get("out_temperature"), sensors.get("out_humidity")); });
   sensors.add(DP, device::out, "out_dewPoint", [&](){ return dewPoint(sensors.get("out_temperature"), sensors.get("out_humidity")); });
+  sensors.depends("out_absoluteHumidity", {"out_temperature", "out_humidity"});
+  sensors.depends("out_dewPoint", {"out_temperature", "out_humidity"});
   
   /* Внутренний датчик */
   sensors.add(P, device::in, 0x77, "in_pressure",    in_pres, true);
@@ -69,6 +71,8 @@ void sensors_config() {
 
   sensors.add(AH, device::in, "in_absoluteHumidity", [&](){ return absoluteHumidity(sensors.get("in_temperature"), sensors.get("in_humidity")); });
   sensors.add(DP, device::in, "in_dewPoint", [&](){ return dewPoint(sensors.get("in_temperature"), sensors.get("in_humidity")); });
+  sensors.depends("in_absoluteHumidity", {"in_temperature", "in_humidity"});
+  sensors.depends("in_dewPoint", {"in_temperature", "in_humidity"});
 }
 
 #endif
@@ -5,47 +5,132 @@
                        Мин  Макс   Шаг    Заголовок      Ед. измер.
 |---------------------|----|------|------|--------------|---------| */
 knob_t *S = new knob_t(0,   40,    ".1",  "Скорость в.", "м/c");
+knob_t *G = new knob_t(0,   60,    ".1",  "Порывы в.",   "м/c");
 
 /* Параметры конфигурации для расчета скорости ветра */
 #define  windSpeed_Pin 14       // GPIO микроконтроллера к которому подключен чашечный анемометр
 #define  windSpeed_Pulses 1     // Количество импульсов на один оборот чашечного анемометра
 #define  windSpeed_Correction 0 // Коэффициент поправки. Разница в скорости м/с между измеренным и фактическим значением полученная при калибровки
 #define  windSpeed_Radius 100   // Радиус чашечного анемометра от центра до середины чашечки в милиметрах
+#define  windSpeed_Ring 128     // Кольцевой буфер меток времени для мгновенной скорости (степень двойки, 2 с при 64 Гц - 40 м/с, разбор раз в секунду)
+#define  windSpeed_Spacing 2000 // Минимальный интервал между импульсами в микросекундах (подавление дребезга, до 500 Гц)
+#define  windSpeed_History 600  // Глубина посекундной истории для расчета средних за 2 и 10 минут и порывов (секунд)
 
-uint32_t windSpeed_Hz = 0;       // Тут будет зафиксирована частота за ПЛАВАЮЩИЙ интервал времени
-float    windSpeed = 0;          // Тут будет зафиксирована скорость ветра
+/* Импульсный вход анемометра (кольцевой буфер меток времени ведет подсистема pulse.h) */
+pulseChannel *windSpeed_Channel = 0;
 
-/* Функция, регистрирующая импульсы с чашечного анемометра */
-void ICACHE_RAM_ATTR pulseDetected() {
-  ++windSpeed_Hz;
+/* Посекундная история: количество импульсов и фактическая длительность секунды в ms */
+uint16_t windSpeed_Count[windSpeed_History] = {0};
+uint16_t windSpeed_Time[windSpeed_History]  = {0};
+uint16_t windSpeed_Position = 0;
+uint16_t windSpeed_Filled = 0;
+
+uint32_t windSpeed_LastPulse = 0;  // Метка времени последнего разобранного импульса
+bool     windSpeed_HasPulse = false;
+uint32_t windSpeed_Seen = 0;       // Счетчик импульсов канала на момент последнего разбора
+uint32_t windSpeed_Lost = 0;       // Счетчик переполнений кольцевого буфера на момент последнего разбора
+uint32_t windSpeed_LastDrain = 0;  // Метка времени последнего разбора очереди
+
+float windSpeed = 0;       // Мгновенная скорость по периоду между двумя последними импульсами
+float windSpeed_3s = 0;    // Средняя за 3 секунды
+float windSpeed_2m = 0;    // Средняя за 2 минуты
+float windSpeed_10m = 0;   // Средняя за 10 минут
+float windSpeed_Gust = 0;  // Максимальный порыв (максимум 3-х секундного среднего за 10 минут, по методике ВМО)
+
+/* Перевод количества импульсов за интервал (в секундах) в скорость ветра м/с */
+float windSpeedCalc(float pulses, float time) {
+  if (pulses <= 0 or time <= 0) return 0;
+  float circumference = 3.14159 * 2 * windSpeed_Radius;             // Длинна окружности анемометра в милиметрах
+  float distance = (pulses / windSpeed_Pulses) * circumference;    // Пройденое растояние в милиметрах
+  return distance / time / 1000 + windSpeed_Correction;            // Скорость ветра с учетом коректировки
 }
 
-/* Функция, производящая расчет скорости ветра */
-void pulseCounter() {
-  detachInterrupt(windSpeed_Pin); // Отключаем регистрацию импульсов на время расчета
-  /* Расчет скорости ветра */
-  if (windSpeed_Hz) {
-    float time = cron.lastRun("Wind Speed Calculation") / 1000;         // Время прошедшее с последнего расчета скорости ветра в секундах
-    float circumference = 3.14 * 2 * windSpeed_Radius;                  // Длинна окружности анемометра в милиметрах
-    float distance = (windSpeed_Hz / windSpeed_Pulses) * circumference; // Пройденое растояние в милиметрах
-    float speed = distance / time / 1000;                               // Скорость в метрах в секунду (грязная)
-    windSpeed = speed + windSpeed_Correction;                           // Скорость ветра с учетом коректировки
-  } else windSpeed = 0;
-  /* Сброс частоты */
-  windSpeed_Hz = 0;
-  attachInterrupt(windSpeed_Pin, pulseDetected, FALLING); // Возобновляем регистрацию импульсов
+/* Средняя скорость за последние seconds секунд посекундной истории */
+float windSpeedAverage(uint16_t seconds) {
+  if (seconds > windSpeed_Filled) seconds = windSpeed_Filled;
+  uint32_t pulses = 0, time = 0;
+  uint16_t i = windSpeed_Position;
+  for (uint16_t n = 0; n < seconds; n++) {
+    i = i ? i - 1 : windSpeed_History - 1;
+    pulses += windSpeed_Count[i];
+    time   += windSpeed_Time[i];
+  }
+  return windSpeedCalc(pulses, time * 0.001);
 }
 
-/* Функция, возвращающая последнее расчетное значение скорости ветра */
-float getWindSpeed() {
-  return windSpeed;
+/* Функция, разбирающая очередь импульсов и производящая расчет скорости ветра (вызывается раз в секунду) */
+void pulseCounter() {
+  float second = 1000000.0;  // Метки времени pulse.h - micros(), микросекунд в секунде
+  uint32_t now = micros();
+  if (!windSpeed_Channel) return;
+
+  /* Количество импульсов за секунду - по счетчику канала, он не теряет импульсы при переполнении буфера */
+  uint32_t count = windSpeed_Channel->count;
+  uint16_t pulses = count - windSpeed_Seen;
+  windSpeed_Seen = count;
+
+  /* Разбор очереди: мгновенная скорость по периоду последних импульсов */
+  uint32_t stamp, lost = windSpeed_Channel->ringLost, previous = windSpeed_LastPulse;
+  bool gap = lost != windSpeed_Lost, had = windSpeed_HasPulse;
+  windSpeed_Lost = lost;
+  while (windSpeed_Channel->pop(stamp)) {
+    if (windSpeed_HasPulse and !gap) windSpeed = windSpeedCalc(1, (stamp - windSpeed_LastPulse) / second);
+    windSpeed_LastPulse = stamp;
+    windSpeed_HasPulse = true;
+  }
+  /* Буфер переполнялся (долгая задержка основного цикла) - соседние метки не подряд, средний период по счетчику */
+  if (gap and pulses) {
+    uint32_t last = windSpeed_Channel->last;
+    if (had and last != previous) windSpeed = windSpeedCalc(pulses, (last - previous) / second);
+    windSpeed_LastPulse = last;
+    windSpeed_HasPulse = true;
+  }
+  /* Импульсов нет дольше 3 секунд - период не определен, считаем штиль */
+  if (windSpeed_HasPulse and (now - windSpeed_LastPulse) / second > 3) {
+    windSpeed_HasPulse = false;
+    windSpeed = 0;
+  }
+
+  /* Фактическая длительность секунды по micros() (планировщик вызывает задачу с опозданием) */
+  uint32_t time = windSpeed_LastDrain ? (now - windSpeed_LastDrain) / second * 1000 : cron::time_1s;
+  windSpeed_LastDrain = now;
+
+  windSpeed_Count[windSpeed_Position] = pulses;
+  windSpeed_Time[windSpeed_Position]  = time;
+  if (++windSpeed_Position >= windSpeed_History) windSpeed_Position = 0;
+  if (windSpeed_Filled < windSpeed_History) windSpeed_Filled++;
+
+  windSpeed_3s  = windSpeedAverage(3);
+  windSpeed_2m  = windSpeedAverage(120);
+  windSpeed_10m = windSpeedAverage(600);
+
+  /* Порыв: максимум скользящего 3-х секундного среднего за 10 минут */
+  windSpeed_Gust = 0;
+  if (windSpeed_Filled >= 3) {
+    uint16_t i = windSpeed_Position;
+    uint32_t pulses3[3] = {0}, time3[3] = {0};
+    for (uint16_t n = 0; n < windSpeed_Filled; n++) {
+      i = i ? i - 1 : windSpeed_History - 1;
+      pulses3[n % 3] = windSpeed_Count[i];
+      time3[n % 3]   = windSpeed_Time[i];
+      if (n < 2) continue;
+      float gust = windSpeedCalc(pulses3[0] + pulses3[1] + pulses3[2], (time3[0] + time3[1] + time3[2]) * 0.001);
+      if (gust > windSpeed_Gust) windSpeed_Gust = gust;
+    }
+  }
 }
 
 void sensors_config() {
-  pinMode(windSpeed_Pin, INPUT_PULLUP);                             // Конфигурируем порт микроконтроллера как вход с активным встроенным подтягивающим резистором
-  attachInterrupt(windSpeed_Pin, pulseDetected, FALLING);           // Регистрация импульсов с чашечного анемометра по прерыванию на землю
-  cron.add(cron::time_10s, pulseCounter, "Wind Speed Calculation"); // Задача в планировщике для расчета скорости ветра
-  sensors.add(S, device::out, "windSpeed", getWindSpeed);           // Добавляем сенсор скорости ветра в web интерфейс
+  /* Регистрация импульсов с чашечного анемометра по прерыванию на землю (вход с подтяжкой), сенсоры частоты и итога не нужны */
+  windSpeed_Channel = pulse.add(windSpeed_Pin, "windPulses", 0, 0, 0, 0, windSpeed_Spacing, windSpeed_Ring, FALLING);
+  if (!windSpeed_Channel) return;
+  cron.add(cron::time_1s, pulseCounter, "Wind Speed Calculation", cron::high);  // Задача в планировщике для разбора очереди импульсов и расчета скорости ветра
+  /* Добавляем сенсоры скорости ветра в web интерфейс */
+  sensors.add(S, device::out, "windSpeed",    [&](){ return windSpeed_3s; });
+  sensors.add(S, device::out, "windSpeed2m",  [&](){ return windSpeed_2m; });
+  sensors.add(S, device::out, "windSpeed10m", [&](){ return windSpeed_10m; }, true);
+  sensors.add(G, device::out, "windGust",     [&](){ return windSpeed_Gust; }, true);
+  sensors.add(S, device::out, "windSpeedInstant", [&](){ return windSpeed; });
 }
 
 #endif
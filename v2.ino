@@ -5,6 +5,12 @@
 
 #define consoleSpeed 115200
 
+/* Режим питания от батареи с глубоким сном (требуется перемычка GPIO16 - RST), описание в battery.h */
+//#define batteryMode
+
+/* Файловая система LittleFS вместо SPIFFS (однократная миграция конфигурации, описание в storage.h) */
+//#define littleFS
+
 /* Библиотеки которые необходимо обязательно скачать */
 #include <ArduinoJson.h>  // https://github.com/bblanchon/ArduinoJson (не выше v.5.13.5)
 #include <PubSubClient.h> // https://github.com/knolleary/pubsubclient
@@ -14,18 +20,27 @@ int z=0;
 int c = 0;
 int b=0;
 /* Файлы проекта (последовательность загрузки имеет значение) */
+#include "storage.h"      // Файловая система (SPIFFS или LittleFS)
 #include "config.h"       // Описание системы работающей с фалом конфигурации 
 #include "tools.h"        // Вспомогательные утилиты
+#include "supervisor.h"   // Учет выполняемых операций для разбора зависаний и аварийных перезагрузок
 #include "cron.h"         // Планировщик задач
+#include "i2c.h"          // Менеджер шины i2c
 #include "wifi.h"         // Обслуживание режимов работы беспроводной сети
 #include "sensors.h"      // Обслуживание датчиков
 #include "webserver.h"    // http сервер
 #include "services.h"     // Описание взаимодействия с внешними сервисами
 #include "gpio.h"         // Обслуживание GPIO
+#include "pulse.h"        // Импульсные входы (анемометры, осадкомеры, расходомеры)
+#include "collector.h"    // Сбор показаний нескольких станций на одной по UDP
+#ifdef batteryMode
+  #include "battery.h"    // Режим питания от батареи
+#endif
 
 
 #include "users_auto.h";        // Пользовательская конфигурация датчиков, именно тут описывается с какими датчиками работать
-#include "ds3231.h"
+#include "ds3231.h"       // Часы реального времени DS3231 и синхронизация с NTP
+#include "multicast.h"    // Рассылка показаний в локальную сеть по UDP multicast
 //#include "users_bme280_x2.h"; // Пример для двух датчиков BME280
 //#include "users_ds18.h";      // Пример для датчиков DS18B20
 //#include "users_wspeed.h";    // пример для самодельного анемометра
@@ -38,6 +53,9 @@ void setup() {
   console.println();
 #endif
 
+  /* Запись о зависшей операции, если предыдущий запуск завершился сторожевым таймером или исключением */
+  supervisor.begin();
+
   /* ВАЖНО!: Инициализация параметров конфига (НЕ требует внесения изменений, ВСЕ правится через web интерфейс) */
   conf.add("client_ssid");
   conf.add("client_pass");
@@ -51,8 +69,14 @@ void setup() {
   conf.add("mqtt_login");
   conf.add("mqtt_pass");
   conf.add("mqtt_path");
+  conf.add("mqtt_packed");      // 1 - все показания одним JSON объектом в топик sensors
   conf.add("thingspeak_key");
   conf.add("narodmon_id");
+  conf.add("collector_mode");   // member или collector
+  conf.add("collector_server"); // IP адрес коллектора
+  conf.add("multicast_group");  // Группа рассылки показаний, например 239.0.0.57
+  conf.add("http_idle");        // Ожидание следующего запроса по постоянному соединению, ms (ядро 3.x)
+  conf.add("http_clients");     // Одновременных HTTP соединений, включая ожидающие (ядро 3.x)
 
   conf.add("gpio12", "35"); // превышение температуры
   conf.add("gpio13", "75"); // превышение влажности
@@ -60,18 +84,39 @@ void setup() {
   conf.read();
   //conf.print();
 
+  /* Ограничения соединений web сервера из конфигурации */
+  http.limits();
+
   /* Инициализация датчиков */
   sensors_config();
 
+  /* Часы реального времени (шина i2c уже инициализирована) */
+  ds3231.begin();
+
+  /* Распределение памяти под журналы и задания их обновления в планировщике (журнал с шагом 10 минут - задание httpSensorsLog) */
+  sensors.logPlan();
+
+  /* Восстановление журналов и фильтров после программной перезагрузки (до первого сбора данных) */
+  bool restored = sensors.restore();
+
+#ifdef batteryMode
+  /* Замер, отправка накопленного пакета и глубокий сон (управление не возвращается) */
+  battery.cycle(restored);
+#endif
+
   /* Инициализация GPIO для управления внешней нагрузкой */
   gpio_12_13(); // Простое превышение температуры или влажности (выставляется в WEB интерфейсе)
   gpio_14();    // Расхождение расчетной абсолютной влажности между показаниями с двух датчиков, например, BME280
 
+  /* Обмен показаниями между станциями (после регистрации сенсоров и планирования журналов) */
+  collector.begin();
+  multicast.begin();
+  mqtt.begin();    // Публикация показаний MQTT брокеру по изменению
+
   /* Добавление в планировщик заданий по отправке данных на внешнии ресурсы */
-  cron.add(cron::time_1m, sendDataToMQTT);       // Отправка данных MQTT брокеру
 cron.add(cron::time_5s, Pds);       // Отправка данных MQTT брокеру
-  cron.add(cron::time_5m, sendDataToThingSpeak); // Отправка данных на сервер "ThingSpeak"
-  cron.add(cron::time_5m + cron::minute, sendDataToNarodmon); // Отправка данных на севрер "Народный мониторинг"
+  cron.add(cron::time_5m, sendDataToThingSpeak, "thingSpeak", cron::low); // Отправка данных на сервер "ThingSpeak"
+  cron.add(cron::time_5m + cron::minute, sendDataToNarodmon, "narodmon", cron::low); // Отправка данных на севрер "Народный мониторинг"
 
   /* Добавление в планировщик заданий по контролю датчиков (холодный старт) */
   cron.add(cron::time_1m,  [&]() {
@@ -80,15 +125,15 @@ cron.add(cron::time_5s, Pds);       // Отправка данных MQTT бро
   cron.add(cron::time_5s,  [&]() {
     sensors.dataUpdate();
   }, true); // Сбор данных с датчиков
-  /* Добавление в планировщик задания (горячий старт) */
-  cron.add(cron::time_10m, [&]() {
-    sensors.logUpdate();
-  }, "httpSensorsLog"); // Обновление журнала (httpSensorsLog - не обязательный уникальный ID для быстрого поиска задания другими программными модулями)
 }
 
 void loop() {
-  /* Обработчики */
+  /* Обработчики (этапы цикла отмечаются для разбора зависаний) */
+  supervisor.loop();
+  supervisor.stage(supervisor::wifi);
   wifi.handleEvents();
+  supervisor.stage(supervisor::http);
   http.handleClient();
+  supervisor.stage(supervisor::cron);
   cron.handleEvents();
 }
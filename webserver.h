@@ -1,14 +1,18 @@
 #ifndef WEBSERVER_H
 #define WEBSERVER_H
 
+#include <core_version.h>
 #include <MD5Builder.h>
-#include <FS.h>
+#include "storage.h"
 #include <ESP8266WebServer.h>
 #include "detail/RequestHandlersImpl.h"
 
 #include "config.h"
 #include "cron.h"
 #include "tools.h";
+#include "gzip.h"
+#include "bundle.h"
+#include "supervisor.h"
 
 class http: public ESP8266WebServer {
   public:
@@ -17,12 +21,51 @@ class http: public ESP8266WebServer {
 
     /* sys */
     void init();
+    /*
+       Ограничения соединений из конфигурации (вызывается в setup() после conf.read()):
+        http_idle    - сколько ms постоянное соединение ждет следующий запрос (по умолчанию idleDefault)
+        http_clients - одновременных соединений: обслуживаемое и ожидающие очереди (по умолчанию clientsDefault)
+    */
+    void limits();
+    /*
+       Обработка клиентов с учетом запроса в supervisor (URI отмечается при разборе запроса, ядро 3.x)
+    */
+    void handleClient();
     bool authorized();
     String codeTranslate(int code) { return ESP8266WebServer::responseCodeToString(code); }
 
     /* headers */
     void sendServerHeaders();
 
+    /*
+       Кэш ответа, построенного по данным сенсоров: тело строится заново только при смене поколения
+       (sensors.generation для показаний, sensors.structure для состава сенсоров). ETag - идентификатор
+       загрузки и поколение, повторный запрос с If-None-Match получает 304 без построения ответа.
+    */
+    struct cache_t {
+      uint32_t generation = 0;
+      String body;
+    };
+    void sendCached(cache_t &cache, uint32_t generation, std::function<String(void)> build);
+
+    /*
+       Отправка JSON ответа, сжатого gzip на лету, если клиент его принимает (Accept-Encoding) и ответ
+       достаточно велик. Потоковый вариант принимает функцию, которая отдает ответ порциями.
+    */
+    bool acceptsGzip();
+    void sendJson(const String &answer);
+    void sendJson(std::function<void(std::function<void(const String &)>)> stream);
+    enum { gzipThreshold = 512 };
+    String bootId = this->_getRandomHexString().substring(0, 8);
+
+    enum {
+      idleDefault    = 2000,
+      clientsDefault = 4
+    };
+    uint32_t idle = http::idleDefault;
+    uint8_t clients = http::clientsDefault;
+    bool supervised = false;
+
     /* handler */
     bool fsHandler(String path);
 
@@ -35,11 +78,15 @@ class http: public ESP8266WebServer {
     void api_spiffs_upload();
     void api_spiffs_upload_handler();
     void api_spiffs_list();
+    void api_spiffs_list(const String &upload);
+    enum { uploadBuffer = 4096 };  // Буфер загрузки файлов: запись во flash целыми секторами
     void api_spiffs_delete();
     void api_system_info();
     void api_system_reboot();
     void api_system_hardReset();
     void api_system_i2c_scaner();
+    void api_system_i2c_stats();
+    void api_system_fs_bench();
     void api_system_update();
     void api_system_update_handler();
 
@@ -55,6 +102,18 @@ class http: public ESP8266WebServer {
     String cookiesKey  = this->md5(this->_getRandomHexString());
     String cookiesName = String(ESP.getChipId());
 
+    /* Кэши ответов API */
+    cache_t sensorsCache, structureCache;
+
+    /* Статистика обновления прошивки для ответа на загрузку */
+    struct update_t {
+      bool compressed = false;   // Образ сжат gzip (распаковывает загрузчик eboot при перезагрузке)
+      uint32_t total = 0;        // Размер запроса по Content-Length
+      uint32_t received = 0;
+      uint32_t start = 0;
+      uint32_t time = 0;
+    } update;
+
     /* secure */
     byte securityLevel = 0;
     byte securityFail  = 3;
@@ -70,7 +129,7 @@ class http: public ESP8266WebServer {
    Инициализация web сервера микроконтроллера
 */
 void http::init() {
-  const char *headerkeys[] = {"User-Agent", "Cookie", "Accept-Encoding", "If-None-Match"};
+  const char *headerkeys[] = {"User-Agent", "Cookie", "Accept-Encoding", "If-None-Match", "Content-Length"};
   this->collectHeaders(headerkeys, sizeof(headerkeys) / sizeof(char*));
 
   this->on("/api/sensors",           HTTP_GET,  [this](){ api_sensors(); });
@@ -85,16 +144,70 @@ void http::init() {
   this->on("/api/system/reboot",     HTTP_POST, [this](){ api_system_reboot(); });
   this->on("/api/system/hardReset",  HTTP_POST, [this](){ api_system_hardReset(); });
   this->on("/api/system/i2c",        HTTP_GET,  [this](){ api_system_i2c_scaner(); });
+  this->on("/api/system/i2c/stats",  HTTP_GET,  [this](){ api_system_i2c_stats(); });
+  this->on("/api/system/fs/bench",   HTTP_POST, [this](){ api_system_fs_bench(); });
   this->on("/api/system/update",     HTTP_POST, [this](){ api_system_update(); }, [this](){ api_system_update_handler(); });
   
   this->onNotFound([this](){ 
     this->sendServerHeaders();
     if(!this->fsHandler(this->uri())) this->send(404);
   });
-  this->begin();
+  /*
+     Постоянные соединения HTTP/1.1 требуют ядра ESP8266 3.x (keepAlive, addHook и WiFiServer::begin с очередью):
+     загрузка панели (страница, скрипты, стили и запросы API) идет по одному соединению без нового TCP
+     рукопожатия на каждый файл. Сервер обслуживает одно соединение за раз: простаивающее соединение
+     закрывается через idle ms (handleClient) и уступает очередь через HTTP_MAX_DATA_AVAILABLE_WAIT, если
+     данные пришли по другому соединению. Соединения сверх clients (одно обслуживаемое и clients - 1 в очереди
+     приема lwIP) отклоняются стеком, чтобы не расходовать PCB и память.
+     На ядре 2.x сервер работает как раньше: соединение закрывается после каждого ответа, ограничений нет.
+  */
+  #if defined(ARDUINO_ESP8266_MAJOR) and ARDUINO_ESP8266_MAJOR >= 3
+    this->keepAlive(true);
+    this->_server.begin(this->_server.port(), http::clientsDefault - 1);
+    this->_server.setNoDelay(true);
+    this->addHook([this](const String &method, const String &url, WiFiClient *client, ContentTypeFunction type) {
+      if (!this->supervised) {
+        supervisor.enter(supervisor::http, url.c_str());
+        this->supervised = true;
+      } return CLIENT_REQUEST_CAN_CONTINUE;
+    });
+  #else
+    #warning "HTTP keep-alive and connection limits require ESP8266 core 3.x"
+    this->begin();
+  #endif
   
   /* задача для планировщика - плавный сброс ограничений доступа к панели управления */
-  cron.add(cron::time_1m, [this](){ security(down); }, "httpSecurity");
+  cron.add(cron::time_1m, [this](){ security(down); }, "httpSecurity", cron::low);
+}
+
+/*  */
+void http::limits() {
+  uint32_t idle = conf.param("http_idle").toInt();
+  uint8_t clients = constrain(conf.param("http_clients").toInt(), 0, 16);
+  this->idle = idle ? idle : http::idleDefault;
+  clients = clients >= 2 ? clients : http::clientsDefault;
+  #if defined(ARDUINO_ESP8266_MAJOR) and ARDUINO_ESP8266_MAJOR >= 3
+    if (clients != this->clients) {
+      this->_server.close();
+      this->_server.begin(this->_server.port(), clients - 1);
+      this->_server.setNoDelay(true);
+    }
+  #endif
+  this->clients = clients;
+}
+
+/*  */
+void http::handleClient() {
+  #if defined(ARDUINO_ESP8266_MAJOR) and ARDUINO_ESP8266_MAJOR >= 3
+    /* Постоянное соединение без нового запроса дольше idle закрывается (ядро ждет до HTTP_MAX_DATA_WAIT) */
+    if (this->_currentStatus == HC_WAIT_READ and this->_currentClient.connected() and !this->_currentClient.available()
+        and millis() - this->_statusChange > this->idle) this->_currentClient.stop();
+  #endif
+  ESP8266WebServer::handleClient();
+  if (this->supervised) {
+    this->supervised = false;
+    supervisor.leave();
+  }
 }
 
 /*
@@ -168,21 +281,47 @@ String http::getContentType(String path) {
    Производится поиск как оригинального файла, так и его архивной gzip копии, последняя имеет приоритет для отправки клиенту.
    Поддерживается система кэширования ETag и если у клиента будет найдена актуальная копия файла, передача не состоится, а
    клиент получит соответствующий заголовок, инициализирующий использование клиентом кэше.
+   В первую очередь файл ищется в пакете web интерфейса (bundle.h), затем среди отдельных файлов.
 */
 bool http::fsHandler(String path) {
   if (path != conf.fileName()) {
     if (path.endsWith(F("/"))) path = F("/index.htm");
+
+    const bundle::entry_t *entry = bundle.find(path);
+    if (entry and (!(entry->flags & bundle::gzipped) or this->acceptsGzip())) {
+      String etag = "\"" + String(entry->etag, HEX) + "\"";
+      #ifdef console
+        console.printf("http: %s %s (bundle), ", this->client().remoteIP().toString().c_str(), path.c_str());
+      #endif
+      if (this->header(F("If-None-Match")) == etag) {
+        this->send(304);
+        #ifdef console
+          console.println(F("304"));
+        #endif
+        return true;
+      }
+      #ifdef console
+        console.println(F("200"));
+      #endif
+      if (entry->flags & bundle::gzipped) this->sendHeader(F("Content-Encoding"), F("gzip"));
+      this->sendHeader(F("ETag"), etag);
+      this->setContentLength(entry->length);
+      this->send(200, bundle.type(entry), "");
+      bundle.send(this->client(), entry);
+      return true;
+    }
+
     String contentType = this->getContentType(path);
     
     /* Поддерживает ли клиент сжатие данных и имеется ли у нас необходимый файл в gzip? */
     if (this->hasHeader(F("Accept-Encoding")) and contentType != F("application/x-gzip") and contentType != F("application/octet-stream")) {
-      if (this->header(F("Accept-Encoding")).indexOf(F("gzip")) != -1 and SPIFFS.exists(path + F(".gz"))) {
+      if (this->header(F("Accept-Encoding")).indexOf(F("gzip")) != -1 and storage.fs().exists(path + F(".gz"))) {
         this->sendHeader(F("Content-Encoding"), F("gzip"));
         path += F(".gz");
-      } else if (!SPIFFS.exists(path)) return false;
-    } else if (!SPIFFS.exists(path)) return false;
+      } else if (!storage.fs().exists(path)) return false;
+    } else if (!storage.fs().exists(path)) return false;
 
-    File file = SPIFFS.open(path, "r");
+    File file = storage.fs().open(path, "r");
     size_t size = file.size();
     #ifdef console
       console.printf("http: %s %s, ", this->client().remoteIP().toString().c_str(), path.c_str());
@@ -223,12 +362,63 @@ void http::sendServerHeaders() {
   this->sendHeader(F("Server"), F("sw: , hw: esp8266"));
 }
 
+/*  */
+void http::sendCached(cache_t &cache, uint32_t generation, std::function<String(void)> build) {
+  String etag = "\"" + this->bootId + "-" + String(generation) + "\"";
+  this->sendHeader(F("ETag"), etag);
+  this->sendHeader(F("Cache-Control"), F("no-cache"));
+  if (this->header(F("If-None-Match")) == etag) {
+    this->send(304);
+    return;
+  }
+  if (cache.generation != generation or !cache.body.length()) {
+    cache.body = build();
+    cache.generation = generation;
+  }
+  this->send(200, headerJson, cache.body);
+}
+
+/*  */
+bool http::acceptsGzip() {
+  return this->header(F("Accept-Encoding")).indexOf(F("gzip")) != -1;
+}
+
+/*  */
+void http::sendJson(const String &answer) {
+  if (answer.length() < http::gzipThreshold or !this->acceptsGzip()) this->send(200, headerJson, answer);
+  else this->sendJson([&](std::function<void(const String &)> out) { out(answer); });
+}
+
+/*  */
+void http::sendJson(std::function<void(std::function<void(const String &)>)> stream) {
+  this->setContentLength(CONTENT_LENGTH_UNKNOWN);
+  if (!this->acceptsGzip()) {
+    this->send(200, headerJson, "");
+    stream([this](const String &chunk) { if (chunk.length()) this->sendContent(chunk); });
+    this->sendContent("");
+    return;
+  }
+  this->sendHeader(F("Content-Encoding"), F("gzip"));
+  this->sendHeader(F("Vary"), F("Accept-Encoding"));
+  this->send(200, headerJson, "");
+  uint32_t start = millis();
+  gzip encoder([this](const uint8_t *data, size_t size) { this->sendContent_P((PGM_P)data, size); });
+  stream([&](const String &chunk) { encoder.write(chunk); });
+  encoder.finish();
+  this->sendContent("");
+  #ifdef console
+    console.printf("http: gzip %s %u -> %u bytes, deflate %u us, total %u ms%s\n", this->uri().c_str(), encoder.in, encoder.total, encoder.time, millis() - start, encoder.stored ? ", stored" : "");
+  #endif
+}
+
 /*
    Предоставляет последние актуальные данные с сенсоров.
+   Ответ без системной информации кэшируется до следующего изменения данных.
 */
 void http::api_sensors() {
   this->sendServerHeaders();
-  this->send(200, headerJson, this->api_system_info_live(sensors.get(false)));
+  if (this->hasArg(F("system"))) this->send(200, headerJson, this->api_system_info_live(sensors.get(false)));
+  else this->sendCached(this->sensorsCache, sensors.generation, [this](){ return this->api_system_info_live(sensors.get(false)); });
 }
 
 /*
@@ -236,16 +426,27 @@ void http::api_sensors() {
 */
 void http::api_sensors_structure() {
   this->sendServerHeaders();
-  this->send(200, headerJson, sensors.list());
+  this->sendCached(this->structureCache, sensors.structure, [](){ return sensors.list(); });
 }
 
 /*
    Предоставляет лог по всем инициализированным сенсорам.
+   Необязательные параметры для медленных каналов и небольших экранов:
+    last   - количество последних точек журнала (диапазон)
+    points - количество точек в ответе, ряд прореживается огибающей min/max прямо по кольцевому буферу
+   В этом случае ответ передается частями (chunked) без построения полного ряда в памяти.
 */
 void http::api_sensors_log() {
   this->sendServerHeaders();
+  if (this->hasArg(F("points")) or this->hasArg(F("last"))) {
+    String name = this->arg(F("sensor"));
+    this->sendJson([&](std::function<void(const String &)> out) {
+      sensors.log(name.length() ? name.c_str() : 0, this->arg(F("last")).toInt(), this->arg(F("points")).toInt(), out);
+    });
+    return;
+  }
   String answer = this->hasArg("sensor") ? sensors.log(this->arg("sensor").c_str()) : sensors.log();
-  this->send(200, headerJson, answer);
+  this->sendJson(answer);
 }
 
 /*
@@ -276,52 +477,114 @@ void http::api_settings_gpio() {
 
 /*
    Загрузка файлов во flash память микроконтроллера.
+   Файл пишется под временным именем и заменяет прежний (storage::replace) только после успешного приема,
+   поэтому прерванная загрузка не портит рабочий файл. Данные копятся в буфере и пишутся во flash
+   порциями по uploadBuffer байт, а не кусками произвольного размера, как их отдает стек TCP.
+   Свободное место проверяется заранее по Content-Length.
 */
 void http::api_spiffs_upload() { /* объеденено с обработчиком */ }
 void http::api_spiffs_upload_handler() {
   static File uploadFile;
-  static bool authorized;
+  static bool authorized, status, full;
+  static String path;
+  static uint8_t *buffer = 0;
+  static size_t fill, size;
+  static uint32_t start;
   HTTPUpload &upload = this->upload();
+  auto flush = [&]() {
+    if (fill and uploadFile.write(buffer, fill) != fill) status = false;
+    fill = 0;
+  };
   switch (upload.status) {
-    case UPLOAD_FILE_START:
+    case UPLOAD_FILE_START: {
+      status = full = false;
       if (!(authorized = this->authorized())) return;
-      if (upload.filename == conf.fileName()) return;
-      uploadFile = SPIFFS.open(upload.filename.startsWith(F("/")) ? upload.filename : "/" + upload.filename, "w");
+      path = upload.filename.startsWith(F("/")) ? upload.filename : "/" + upload.filename;
+      if (path == conf.fileName()) return;
+      FSInfo info;
+      storage.fs().info(info);
+      if ((uint32_t)this->header(F("Content-Length")).toInt() > info.totalBytes - info.usedBytes) {
+        #ifdef console
+          console.printf("upload: %s, no space\n", path.c_str());
+        #endif
+        full = true;
+        return;
+      }
+      bundle.reset();
+      uploadFile = storage.fs().open(path + F(".tmp"), "w");
+      if (!uploadFile) return;
+      if (!buffer) buffer = new uint8_t[http::uploadBuffer];
+      status = true;
+      fill = size = 0;
+      start = millis();
       blink.setMode(smartBlink::mode_flash4);
       return;
+    }
     case UPLOAD_FILE_WRITE:
-      if (uploadFile) uploadFile.write(upload.buf, upload.currentSize);
+      if (status and buffer) {
+        for (size_t i = 0; i < upload.currentSize; ) {
+          size_t part = http::uploadBuffer - fill < upload.currentSize - i ? http::uploadBuffer - fill : upload.currentSize - i;
+          memcpy(buffer + fill, upload.buf + i, part);
+          fill += part;
+          i += part;
+          if (fill >= http::uploadBuffer) flush();
+        }
+        size += upload.currentSize;
+      } else if (status and uploadFile.write(upload.buf, upload.currentSize) != upload.currentSize) status = false;
       return;
     case UPLOAD_FILE_ABORTED:
     case UPLOAD_FILE_END:
       this->sendServerHeaders();
       if (uploadFile) {
         blink.previous();
+        if (buffer) flush();
         uploadFile.close();
-        if (upload.status != UPLOAD_FILE_END) this->send(400);
-        else this->api_spiffs_list();
-      } else this->send(authorized ? 500 : 401);
+        delete [] buffer;
+        buffer = 0;
+        bundle.reset();
+        storage.invalidate();
+        if (upload.status != UPLOAD_FILE_END or !status) {
+          storage.fs().remove(path + F(".tmp"));
+          this->send(upload.status != UPLOAD_FILE_END ? 400 : 500);
+          return;
+        }
+        if (!storage.replace(path + F(".tmp"), path)) {
+          storage.fs().remove(path + F(".tmp"));
+          this->send(500);
+          return;
+        }
+        uint32_t time = millis() - start;
+        String answer;
+        answer += "\"size\":"  + String(size) + ",";
+        answer += "\"time\":"  + String(time) + ",";
+        answer += "\"speed\":" + String(time ? size / 1000.0 / time : 0, 3);  // МБ/с
+        #ifdef console
+          console.printf("upload: %s, %u bytes in %u ms\n", path.c_str(), size, time);
+        #endif
+        this->api_spiffs_list("{" + answer + "}");
+      } else this->send(authorized ? (full ? 507 : 500) : 401);
   }
 }
 
 /*
    Формирует список файлов, находящихся во flash памяти микроконтроллера.
    Обязательно исключайте из списка Ваши файлы конфигурации.
+   Список кэшируется (storage.h) и строится заново только после загрузки или удаления файлов.
 */
 void http::api_spiffs_list() {
+  this->api_spiffs_list("");
+}
+
+/* upload - статистика только что завершенной загрузки файла */
+void http::api_spiffs_list(const String &upload) {
   this->sendServerHeaders();
   if (this->authorized()) {
-    String answer;
     FSInfo spiffs;
-    SPIFFS.info(spiffs);
-    Dir obj = SPIFFS.openDir(F("/"));
-    while (obj.next()) {
-      if (obj.fileName() == conf.fileName()) continue;
-      if (answer.length()) answer += ',';
-      answer += "\"" + obj.fileName().substring(1) + "\":" + String(obj.fileSize());
-    }
+    storage.fs().info(spiffs);
+    String answer = storage.list(conf.fileName());
     if (answer.length()) answer = "{" + answer + "}";
-    this->send(200, headerJson, "{\"spiffs\":" + String(spiffs.totalBytes) + ",\"list\":[" + answer + "]}");
+    String extra = upload.length() ? ",\"upload\":" + upload : "";
+    this->send(200, headerJson, "{\"spiffs\":" + String(spiffs.totalBytes) + ",\"list\":[" + answer + "]" + extra + "}");
   } else this->send(401);
 }
 
@@ -334,8 +597,10 @@ void http::api_spiffs_delete() {
   if (this->authorized()) {
     if (this->hasArg(F("file"))) {
       String deleteFile = "/" + this->arg(F("file"));
-      if (deleteFile != conf.fileName() and SPIFFS.exists(deleteFile)) {
-        SPIFFS.remove(deleteFile);
+      if (deleteFile != conf.fileName() and storage.fs().exists(deleteFile)) {
+        storage.fs().remove(deleteFile);
+        storage.invalidate();
+        bundle.reset();
         this->api_spiffs_list();
         return;
       }
@@ -350,7 +615,7 @@ void http::api_system_info() {
   this->sendServerHeaders();
   if (this->authorized()) {
     FSInfo spiffs;
-    SPIFFS.info(spiffs);
+    storage.fs().info(spiffs);
     
     String answer;
     answer += "\"bmac\":\""           + conf.param("client_bmac") + "\",";    
@@ -377,6 +642,7 @@ void http::api_system_info() {
     answer += "\"spiffsUsedBytes\":"  + String(spiffs.usedBytes) + ",";
     answer += "\"spiffsBlockSize\":"  + String(spiffs.blockSize) + ",";
     answer += "\"spiffsPageSize\":"   + String(spiffs.pageSize) + ",";
+    answer += "\"fileSystem\":\""     + String(storage.name()) + "\",";
     answer += "\"sketchVersion\":\"v1.1 beta (16.08.2020)\",";
     answer += "\"sketchSize\":"       + String(ESP.getSketchSize()) + ",";        // uint32_t
     answer += "\"sketchMD5\":\""      + ESP.getSketchMD5() + "\",";
@@ -384,9 +650,11 @@ void http::api_system_info() {
     answer += "\"resetReason\":\""    + ESP.getResetReason() + "\",";
     answer += "\"resetInfo\":\""      + ESP.getResetInfo() + "\",";
     answer += "\"bootVersion\":\""    + String(ESP.getBootVersion()) + "\",";      // uint8_t
+    answer += "\"supervisor\":"       + supervisor.report() + ",";
+    answer += "\"cronDeferred\":"     + String(cron.deferred) + ",";              // Запуски, отложенные по бюджету
     //answer += "\"bootMode\":\""     + String(ESP.getBootMode()) + "\",";         // uint8_t
     answer += "\"millis\":"           + String(millis());
-    this->send(200, headerJson, "{" + answer + "}");
+    this->sendJson("{" + answer + "}");
   } else this->send(401);
 }
 
@@ -414,6 +682,7 @@ void http::api_system_reboot() {
   this->sendServerHeaders();
   if (this->authorized()) {
     this->send(202);
+    sensors.save();
     delay(2000); // задержка обязательна, иначе контроллер уйдет на перезагрузку до завершения передачи!
     ESP.restart();
   } else this->send(401);
@@ -435,26 +704,52 @@ void http::api_system_hardReset() {
 
 /*
    Сканер шины i2c.
-   Формирует список устройств с их статусами.
+   Формирует список устройств с их статусами по результату последнего фонового сканирования и его возраст.
+   Сканирование выполняется планировщиком по несколько адресов за проход и не блокирует обработку запросов,
+   параметр refresh=1 запускает новое сканирование.
 */
 void http::api_system_i2c_scaner() {
   this->sendServerHeaders();
   if (this->authorized()) {
-    String answer;
-    for (byte address = 1; address < 127; address++) {
-      Wire.beginTransmission(address);
-      byte status = Wire.endTransmission();
-      if (!status or status == 4) {
-        answer += answer.length() ? "," : "";
-        answer += "\"" + String((address < 16) ? "0" : "") + String(address, HEX) + "\":" + (!status ? '1' : '0');
-      }
-    }
-    this->send(200, headerJson, "{\"list\":{" + answer + "}}");
+    if (this->arg(F("refresh")) == "1") i2c.scan();
+    this->send(200, headerJson, i2c.scanResult());
+  } else this->send(401);
+}
+
+/*
+   Статистика шины i2c: частота, количество восстановлений, время шины за цикл опроса
+   и счетчики транзакций, ошибок и времени (мкс) по каждому адресу.
+*/
+void http::api_system_i2c_stats() {
+  this->sendServerHeaders();
+  if (this->authorized()) this->send(200, headerJson, i2c.stats());
+  else this->send(401);
+}
+
+/*
+   Замер задержек файловой системы (storage.h): files временных файлов по size байт.
+   Для сравнения SPIFFS и LittleFS запускается на двух прошивках скриптом tools/fs_bench.py.
+*/
+void http::api_system_fs_bench() {
+  this->sendServerHeaders();
+  if (this->authorized()) {
+    uint16_t files = this->hasArg(F("files")) ? constrain(this->arg(F("files")).toInt(), 1, 128) : 32;
+    uint16_t size  = this->hasArg(F("size"))  ? constrain(this->arg(F("size")).toInt(), 0, 8192) : 1024;
+    FSInfo info;
+    storage.fs().info(info);
+    if ((uint32_t)files * (size + info.blockSize) > info.totalBytes - info.usedBytes) this->send(507);
+    else this->send(200, headerJson, storage.benchmark(files, size));
   } else this->send(401);
 }
 
 /*
    Обновление программы микроконтроллера.
+   Принимается как обычный образ, так и сжатый gzip (v2.ino.generic.bin.gz, примерно вдвое меньше):
+   ядро (2.7+) записывает сжатый образ как есть, а загрузчик eboot распаковывает его при перезагрузке.
+   MD5 (имя файла) проверяется по принятому потоку. Запись во flash уже буферизуется классом Update
+   посекторно (4 КБ), поэтому дополнительный буфер не нужен.
+   Сервер однопоточный и во время приема образа другие запросы не обслуживает, поэтому ход загрузки
+   показывает клиент (xhr.upload.onprogress), а итог (принято байт, время, скорость) приходит в ответе.
 */
 void http::api_system_update() { /* объеденено с обработчиком */ }
 void http::api_system_update_handler() {
@@ -470,21 +765,60 @@ void http::api_system_update_handler() {
       Update.begin((ESP.getFreeSketchSpace() - 0x1000) & 0xFFFFF000);
       Update.setMD5(upload.filename.c_str());
       blink.setMode(smartBlink::mode_flash4);
+      this->update = update_t();
+      this->update.total = this->header(F("Content-Length")).toInt();
+      this->update.start = millis();
       return;
     case UPLOAD_FILE_WRITE:
-      if (status) Update.write(upload.buf, upload.currentSize);
+      if (status) {
+        if (!this->update.received) this->update.compressed = upload.currentSize >= 2 and upload.buf[0] == 0x1F and upload.buf[1] == 0x8B;
+        Update.write(upload.buf, upload.currentSize);
+        #ifdef console
+          uint32_t step = this->update.total / 10;
+          if (step and (this->update.received + upload.currentSize) / step != this->update.received / step) {
+            console.printf("update: %u%%\n", (this->update.received + upload.currentSize) * 100 / this->update.total);
+          }
+        #endif
+        this->update.received += upload.currentSize;
+        this->update.time = millis() - this->update.start;
+      }
       return;
     case UPLOAD_FILE_ABORTED:
+      /* Клиент оборвал передачу: образ не принимается, Update освобождается для следующей попытки */
+      if (status) {
+        #ifdef console
+          console.printf("update: aborted after %u bytes\n", this->update.received);
+        #endif
+        blink.previous();
+        Update.end(false);
+        status = false;
+      }
+      return;
     case UPLOAD_FILE_END:
       this->sendServerHeaders();
       if (status) {
+        this->update.time = millis() - this->update.start;
+        /* end() проверяет MD5 и заголовок образа, поэтому ответ строится по его результату */
+        bool success = Update.end(true);
+        status = false;
+        #ifdef console
+          console.printf("update: %u bytes%s in %u ms, %s\n", this->update.received, this->update.compressed ? " (gzip)" : "", this->update.time, success ? "ok" : "failed");
+        #endif
         blink.previous();
         String answer;
-        answer += "\"status\":" + String(Update.hasError() ? "false" : "true") + ',';
-        answer += "\"error\":"  + String(Update.getError());
+        answer += "\"status\":"     + String(success ? "true" : "false") + ',';
+        answer += "\"compressed\":" + String(this->update.compressed ? "true" : "false") + ",";
+        answer += "\"received\":"   + String(this->update.received) + ",";
+        answer += "\"total\":"      + String(this->update.total) + ",";
+        answer += "\"time\":"       + String(this->update.time) + ",";
+        answer += "\"speed\":"      + String(this->update.time ? (uint32_t)((uint64_t)this->update.received * 1000 / this->update.time) : 0) + ",";
+        answer += "\"error\":"      + String(Update.getError());
         this->send(200, headerJson, "{" + answer + "}");
-        delay(2000); // задержка обязательна, иначе контроллер уйдет на перезагрузку до завершения передачи!
-        if (Update.end(!Update.hasError())) ESP.restart();
+        if (success) {
+          delay(2000); // задержка обязательна, иначе контроллер уйдет на перезагрузку до завершения передачи!
+          sensors.save();
+          ESP.restart();
+        }
       } else this->send(authorized ? 500 : 401);
   }
 }
@@ -26,6 +26,12 @@ class wifi {
     bool transferDataPossible();
     bool isConnected() { return this->connected; }
     void disconnect();
+    /*
+       Подключение к домашней сети для режима питания от батареи: без перехода в режим точки доступа при неудаче,
+       без mDNS и без паузы disconnect(), ожидание адреса не дольше timeout ms.
+       channel и bssid прошлого подключения (если известны) позволяют пропустить сканирование эфира.
+    */
+    bool connect(uint32_t timeout, int32_t channel = 0, const uint8_t *bssid = 0);
 
     /* info */
     IPAddress ip();
@@ -276,6 +282,32 @@ void wifi::disconnect() {
   } delay(1000);
 }
 
+/* */
+bool wifi::connect(uint32_t timeout, int32_t channel, const uint8_t *bssid) {
+  if (!conf.param("client_ssid").length()) return false;
+  WiFi.persistent(false);
+  WiFi.setAutoConnect(false);
+  WiFi.setAutoReconnect(false);
+  if (!WiFi.mode(WIFI_STA)) return false;
+  staConnectedHandler = WiFi.onStationModeConnected([&](const WiFiEventStationModeConnected &evt) { this->staConnected(evt); });
+  staDisconnectedHandler = WiFi.onStationModeDisconnected([&](const WiFiEventStationModeDisconnected &evt) { this->staDisconnected(evt); });
+  if (!WiFi.begin(conf.param("client_ssid").c_str(), conf.param("client_pass").length() ? conf.param("client_pass").c_str() : NULL, channel, bssid)) return false;
+  uint32_t start = millis();
+  while (WiFi.status() != WL_CONNECTED) {
+    if (millis() - start > timeout) {
+      #ifdef console
+        console.printf("wifi: no connection in %u ms\n", timeout);
+      #endif
+      return false;
+    }
+    delay(10);
+  }
+  #ifdef console
+    console.printf("wifi: connected in %u ms%s\n", millis() - start, bssid ? " (known channel)" : "");
+  #endif
+  return true;
+}
+
 /* */
 bool wifi::transferDataPossible() {
   return (WiFi.getMode() == WIFI_STA and this->isConnected());